@@ -0,0 +1,353 @@
+#ifndef BATCH_SOURCE_H
+#define BATCH_SOURCE_H
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cerrno>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+// ===== FUENTES DE LOTES (--serve) =====
+// En modo servicio rank 0 recibe lotes de claves por un transporte local y
+// devuelve sus rankings. Formato binario nativo, igual en los tres:
+//   pedido     uint64 count + count claves del tipo de --key
+//   respuesta  BatchReply + count rankings int64 en el orden del pedido
+//              (count = 0: lote rechazado)
+// Transportes:
+//   pipe:RUTA    pedidos por RUTA y respuestas por RUTA.out (FIFOs: se crean
+//                si no existen). El cliente abre RUTA para escribir y después
+//                RUTA.out para leer. El fin del archivo termina el servicio
+//   socket:RUTA  socket UNIX de tipo stream; una conexión a la vez, pedidos y
+//                respuestas por la misma conexión. Al cerrarse se espera otra
+//   spool:DIR    cada archivo DIR/*.keys (solo claves, sin count) es un lote,
+//                en orden de nombre; la respuesta va a NOMBRE.rank y el pedido
+//                se borra. Escribir con otro nombre y renombrar a .keys al
+//                terminar. El archivo DIR/stop termina el servicio
+// En pipe y socket un pedido con count = 0 también termina el servicio. Un
+// pedido con count > SERVE_MAX_KEYS se rechaza (respuesta con count = 0) y se
+// corta la conexión; un pedido incompleto es un cliente que se fue: el socket
+// espera otra conexión y el pipe termina. ERROR queda para fallas del
+// transporte (open, accept o read con errno).
+
+struct BatchReply {
+    uint64_t count;
+    double latency_ms;     // desde el lote recibido hasta la respuesta lista
+    double ranking_ms;     // Tp de la malla (fases 1-6)
+    double keys_per_sec;   // count / latencia
+};
+
+// RETRY no sale de next(): read_keys descartó el pedido y hay que leer otro
+enum class BatchStatus { BATCH, END, ERROR, RETRY };
+
+const uint64_t SERVE_MAX_KEYS = 0x7fffffff;  // el reparto usa desplazamientos int (MPI_Scatterv)
+const int SPOOL_POLL_US = 10000;
+
+namespace batch_detail {
+
+inline bool read_full(int fd, void* dst, size_t bytes, bool& eof) {
+    char* out = static_cast<char*>(dst);
+    eof = false;
+    while (bytes > 0) {
+        ssize_t got = read(fd, out, bytes);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) {
+            eof = (got == 0);
+            return false;
+        }
+        out += got;
+        bytes -= got;
+    }
+    return true;
+}
+
+inline bool write_full(int fd, const void* src, size_t bytes) {
+    const char* in = static_cast<const char*>(src);
+    while (bytes > 0) {
+        ssize_t put = write(fd, in, bytes);
+        if (put < 0 && errno == EINTR) continue;
+        if (put <= 0) return false;
+        in += put;
+        bytes -= put;
+    }
+    return true;
+}
+
+inline bool write_reply(int fd, const BatchReply& reply, const int64_t* ranks) {
+    return write_full(fd, &reply, sizeof(reply)) &&
+           write_full(fd, ranks, reply.count * sizeof(int64_t));
+}
+
+// Abre path como FIFO (la crea si no existe)
+inline int open_fifo(const std::string& path, int flags) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 && mkfifo(path.c_str(), 0600) != 0) return -1;
+    return open(path.c_str(), flags);
+}
+
+}  // namespace batch_detail
+
+// Un transporte: begin_batch deja listo el próximo pedido (count claves de
+// key_size bytes), read_keys lee sus claves y reply responde al último
+class BatchSource {
+public:
+    virtual ~BatchSource() = default;
+
+    template <typename Key>
+    BatchStatus next(std::vector<Key>& keys) {
+        BatchStatus status = BatchStatus::RETRY;
+        while (status == BatchStatus::RETRY) {
+            uint64_t count = 0;
+            status = begin_batch(sizeof(Key), count);
+            if (status != BatchStatus::BATCH) return status;
+            keys.resize(count);
+            status = read_keys(keys.data(), count * sizeof(Key));
+        }
+        return status;
+    }
+
+    virtual bool reply(const BatchReply& reply, const int64_t* ranks) = 0;
+    virtual const std::string& error() const { return error_; }
+
+    // spec: pipe:RUTA | socket:RUTA | spool:DIR; nullptr (y error) si no se pudo abrir
+    static std::unique_ptr<BatchSource> create(const std::string& spec, std::string& error);
+
+protected:
+    virtual BatchStatus begin_batch(size_t key_size, uint64_t& count) = 0;
+    // BATCH si leyó las claves, END o RETRY si el pedido quedó incompleto
+    virtual BatchStatus read_keys(void* dst, size_t bytes) = 0;
+
+    BatchStatus fail(const std::string& message) {
+        error_ = message;
+        return BatchStatus::ERROR;
+    }
+
+    std::string error_;
+};
+
+// Pedidos con count por delante sobre un descriptor (pipe y socket)
+class StreamBatchSource : public BatchSource {
+protected:
+    // Descriptor del próximo pedido; -1 si el transporte terminó
+    virtual int request_fd() = 0;
+    // El otro extremo cerró: true si hay otro (el socket acepta otra conexión)
+    virtual bool reopen() { return false; }
+
+    BatchStatus begin_batch(size_t, uint64_t& count) override {
+        // Tras rechazar un pedido demasiado grande sus claves siguen en el
+        // descriptor: se corta la conexión
+        if (drop_) {
+            drop_ = false;
+            if (!reopen()) return BatchStatus::END;
+        }
+        while (true) {
+            int fd = request_fd();
+            if (fd < 0) return fail("no se pudo abrir el transporte");
+            bool eof;
+            if (batch_detail::read_full(fd, &count, sizeof(count), eof)) break;
+            if (!eof) return fail("falló la lectura del pedido");
+            if (!reopen()) return BatchStatus::END;
+        }
+        if (count == 0) return BatchStatus::END;
+        if (count > SERVE_MAX_KEYS) {
+            count = 0;
+            drop_ = true;
+        }
+        return BatchStatus::BATCH;
+    }
+
+    BatchStatus read_keys(void* dst, size_t bytes) override {
+        bool eof;
+        if (batch_detail::read_full(request_fd(), dst, bytes, eof)) return BatchStatus::BATCH;
+        if (!eof) return fail("falló la lectura del pedido");
+        return reopen() ? BatchStatus::RETRY : BatchStatus::END;
+    }
+
+private:
+    bool drop_ = false;
+};
+
+class PipeBatchSource : public StreamBatchSource {
+public:
+    explicit PipeBatchSource(const std::string& path) : path_(path) {}
+    ~PipeBatchSource() override {
+        if (in_ >= 0) close(in_);
+        if (out_ >= 0) close(out_);
+    }
+
+    bool reply(const BatchReply& reply, const int64_t* ranks) override {
+        return out_ >= 0 && batch_detail::write_reply(out_, reply, ranks);
+    }
+
+protected:
+    // Las dos FIFOs en el mismo orden que el cliente (cada open bloquea hasta
+    // que el otro extremo abre la suya)
+    int request_fd() override {
+        if (in_ < 0) {
+            in_ = batch_detail::open_fifo(path_, O_RDONLY);
+            if (in_ >= 0) out_ = batch_detail::open_fifo(path_ + ".out", O_WRONLY);
+            if (out_ < 0) return -1;
+        }
+        return in_;
+    }
+
+private:
+    std::string path_;
+    int in_ = -1, out_ = -1;
+};
+
+class SocketBatchSource : public StreamBatchSource {
+public:
+    explicit SocketBatchSource(const std::string& path) : path_(path) {}
+    ~SocketBatchSource() override {
+        if (client_ >= 0) close(client_);
+        if (listener_ >= 0) {
+            close(listener_);
+            unlink(path_.c_str());
+        }
+    }
+
+    bool listen_on() {
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (path_.size() >= sizeof(addr.sun_path)) return false;
+        std::copy(path_.begin(), path_.end(), addr.sun_path);
+        listener_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener_ < 0) return false;
+        unlink(path_.c_str());
+        return bind(listener_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0 &&
+               listen(listener_, 1) == 0;
+    }
+
+    bool reply(const BatchReply& reply, const int64_t* ranks) override {
+        return client_ >= 0 && batch_detail::write_reply(client_, reply, ranks);
+    }
+
+protected:
+    int request_fd() override {
+        while (client_ < 0) {
+            client_ = accept(listener_, nullptr, nullptr);
+            if (client_ < 0 && errno != EINTR) return -1;
+        }
+        return client_;
+    }
+
+    bool reopen() override {
+        close(client_);
+        client_ = -1;
+        return true;
+    }
+
+private:
+    std::string path_;
+    int listener_ = -1, client_ = -1;
+};
+
+class SpoolBatchSource : public BatchSource {
+public:
+    explicit SpoolBatchSource(const std::string& dir) : dir_(dir) {}
+    ~SpoolBatchSource() override {
+        if (fd_ >= 0) close(fd_);
+    }
+
+    bool reply(const BatchReply& reply, const int64_t* ranks) override {
+        // Respuesta completa con otro nombre y rename: el cliente nunca ve una a medias
+        std::string base = dir_ + "/" + current_.substr(0, current_.size() - EXTENSION.size());
+        std::string temp = base + ".rank.tmp";
+        int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return false;
+        bool ok = batch_detail::write_reply(fd, reply, ranks);
+        ok = (close(fd) == 0) && ok;
+        ok = ok && rename(temp.c_str(), (base + ".rank").c_str()) == 0;
+        unlink((dir_ + "/" + current_).c_str());
+        return ok;
+    }
+
+protected:
+    BatchStatus begin_batch(size_t key_size, uint64_t& count) override {
+        if (fd_ >= 0) {
+            close(fd_);
+            fd_ = -1;
+        }
+        while (true) {
+            std::string stop = dir_ + "/stop";
+            if (access(stop.c_str(), F_OK) == 0) {
+                unlink(stop.c_str());
+                return BatchStatus::END;
+            }
+            DIR* dir = opendir(dir_.c_str());
+            if (!dir) return fail("no se pudo abrir " + dir_);
+            std::vector<std::string> names;
+            while (dirent* entry = readdir(dir)) {
+                std::string name = entry->d_name;
+                if (name.size() > EXTENSION.size() &&
+                    name.compare(name.size() - EXTENSION.size(), EXTENSION.size(), EXTENSION) == 0) {
+                    names.push_back(name);
+                }
+            }
+            closedir(dir);
+            if (names.empty()) {
+                usleep(SPOOL_POLL_US);
+                continue;
+            }
+
+            current_ = *std::min_element(names.begin(), names.end());
+            fd_ = open((dir_ + "/" + current_).c_str(), O_RDONLY);
+            struct stat st;
+            if (fd_ < 0 || fstat(fd_, &st) != 0) return fail("no se pudo leer " + current_);
+            // Tamaño que no es múltiplo de la clave: count 0, el servicio lo rechaza
+            count = (st.st_size % key_size == 0) ? st.st_size / key_size : 0;
+            if (count > SERVE_MAX_KEYS) count = 0;
+            return BatchStatus::BATCH;
+        }
+    }
+
+    BatchStatus read_keys(void* dst, size_t bytes) override {
+        bool eof;
+        if (batch_detail::read_full(fd_, dst, bytes, eof)) return BatchStatus::BATCH;
+        return fail("no se pudo leer " + current_);
+    }
+
+private:
+    inline static const std::string EXTENSION = ".keys";
+    std::string dir_, current_;
+    int fd_ = -1;
+};
+
+inline std::unique_ptr<BatchSource> BatchSource::create(const std::string& spec, std::string& error) {
+    size_t colon = spec.find(':');
+    std::string kind = spec.substr(0, colon), path = (colon == std::string::npos) ? "" : spec.substr(colon + 1);
+    if (path.empty()) {
+        error = "se espera pipe:RUTA, socket:RUTA o spool:DIR";
+        return nullptr;
+    }
+    if (kind == "pipe") return std::make_unique<PipeBatchSource>(path);
+    if (kind == "socket") {
+        auto source = std::make_unique<SocketBatchSource>(path);
+        if (!source->listen_on()) {
+            error = "no se pudo escuchar en " + path;
+            return nullptr;
+        }
+        return source;
+    }
+    if (kind == "spool") {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+            error = path + " no es un directorio";
+            return nullptr;
+        }
+        return std::make_unique<SpoolBatchSource>(path);
+    }
+    error = "transporte desconocido: " + kind;
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef BIT_PACKING_H
+#define BIT_PACKING_H
+
+#include <cstdint>
+#include <cstddef>
+
+// ===== EMPAQUETADO DE BITS =====
+// Secuencia de campos de width bits (0..64) pegados uno tras otro en palabras
+// de 64 bits: el campo i ocupa los bits [i·width, (i+1)·width) y puede cruzar
+// de una palabra a la siguiente. Con frame-of-reference (restar el mínimo) un
+// bloque cuyo rango entra en pocos bits viaja en ese ancho y no en el del tipo.
+//
+// Un frame son 64 campos: ocupan exactamente width palabras, así que un arreglo
+// de frames se puede cortar en cualquier límite de frame sin partir campos
+// (lo que hace MPI al segmentar una reducción).
+
+const size_t FRAME_FIELDS = 64;
+
+// Bits necesarios para representar cualquier valor en [0, max_value]
+inline int bit_width(uint64_t max_value) {
+    return max_value == 0 ? 0 : 64 - __builtin_clzll(max_value);
+}
+
+inline size_t packed_words(size_t fields, int width) {
+    return (fields * width + 63) / 64;
+}
+
+inline size_t packed_frames(size_t fields) {
+    return (fields + FRAME_FIELDS - 1) / FRAME_FIELDS;
+}
+
+// out[0 .. packed_words) debe estar en cero; get(i) devuelve el campo i (< 2^width)
+template <typename Get>
+void pack_bits(size_t fields, int width, Get get, uint64_t* out) {
+    if (width == 0) return;
+    for (size_t i = 0; i < fields; i++) {
+        uint64_t value = get(i);
+        size_t bit = i * width;
+        size_t word = bit >> 6;
+        int offset = bit & 63;
+        out[word] |= value << offset;
+        if (offset + width > 64) out[word + 1] |= value >> (64 - offset);
+    }
+}
+
+// put(i, campo) para cada campo
+template <typename Put>
+void unpack_bits(const uint64_t* in, size_t fields, int width, Put put) {
+    uint64_t mask = (width == 64) ? ~uint64_t(0) : (uint64_t(1) << width) - 1;
+    for (size_t i = 0; i < fields; i++) {
+        if (width == 0) {
+            put(i, uint64_t(0));
+            continue;
+        }
+        size_t bit = i * width;
+        size_t word = bit >> 6;
+        int offset = bit & 63;
+        uint64_t value = in[word] >> offset;
+        if (offset + width > 64) value |= in[word + 1] << (64 - offset);
+        put(i, value & mask);
+    }
+}
+
+// inout[i] += in[i] campo a campo sobre frames completos; las sumas deben
+// caber en width bits (si no, se pierde el acarreo)
+inline void add_packed_frames(const uint64_t* in, uint64_t* inout, size_t frames, int width) {
+    for (size_t f = 0; f < frames; f++) {
+        const uint64_t* a = in + f * width;
+        uint64_t* b = inout + f * width;
+        uint64_t sums[FRAME_FIELDS];
+        unpack_bits(a, FRAME_FIELDS, width, [&](size_t i, uint64_t v) { sums[i] = v; });
+        unpack_bits(b, FRAME_FIELDS, width, [&](size_t i, uint64_t v) { sums[i] += v; });
+        for (int w = 0; w < width; w++) b[w] = 0;
+        pack_bits(FRAME_FIELDS, width, [&](size_t i) { return sums[i]; }, b);
+    }
+}
+
+#endif
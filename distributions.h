@@ -0,0 +1,149 @@
+#ifndef DISTRIBUTIONS_H
+#define DISTRIBUTIONS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <string>
+#include <type_traits>
+
+#include "philox.h"
+
+// ===== DISTRIBUCIONES DE ENTRADA =====
+// Formas de datos que cambian el comportamiento del sort y del ranking. Igual
+// que la uniforme, cada una es función solo de (seed, i, N): cualquier proceso
+// genera cualquier tramo del arreglo global sin generar lo anterior.
+//   uniform        philox_fill (la de siempre, idéntica bit a bit)
+//   sorted         ascendente de min a max (con repetidos si el rango < N)
+//   reverse        descendente
+//   nearly-sorted  sorted con NEARLY_SORTED_NOISE de elementos al azar
+//   few-unique     FEW_UNIQUE_VALUES valores repartidos en [min, max]
+//   gaussian       normal centrada en el medio del rango, sigma = rango / 8,
+//                  recortada a [min, max]
+//   zipf           valor min + (r - 1)·paso con r ~ Zipf(ZIPF_EXPONENT) sobre
+//                  hasta ZIPF_VALUES rangos: pocos valores muy frecuentes
+
+enum class Distribution { UNIFORM, SORTED, REVERSE, NEARLY_SORTED, FEW_UNIQUE, GAUSSIAN, ZIPF };
+
+const double NEARLY_SORTED_NOISE = 0.01;
+const int FEW_UNIQUE_VALUES = 16;
+const double ZIPF_EXPONENT = 1.2;
+const uint64_t ZIPF_VALUES = uint64_t(1) << 20;
+
+inline const char* distribution_name(Distribution dist) {
+    switch (dist) {
+        case Distribution::SORTED: return "sorted";
+        case Distribution::REVERSE: return "reverse";
+        case Distribution::NEARLY_SORTED: return "nearly-sorted";
+        case Distribution::FEW_UNIQUE: return "few-unique";
+        case Distribution::GAUSSIAN: return "gaussian";
+        case Distribution::ZIPF: return "zipf";
+        default: return "uniform";
+    }
+}
+
+inline bool parse_distribution(const std::string& text, Distribution& dist) {
+    const Distribution all[] = {Distribution::UNIFORM, Distribution::SORTED, Distribution::REVERSE,
+                                Distribution::NEARLY_SORTED, Distribution::FEW_UNIQUE,
+                                Distribution::GAUSSIAN, Distribution::ZIPF};
+    for (Distribution d : all) {
+        if (text == distribution_name(d)) {
+            dist = d;
+            return true;
+        }
+    }
+    return false;
+}
+
+namespace dist_detail {
+
+// Posición del elemento index como fracción num / den de [min, max), con
+// den <= 2^64 (exacta para sorted/reverse: el valor entero sale sin redondeo)
+struct Fraction {
+    unsigned __int128 num, den;
+};
+
+inline double unit_real(uint32_t hi, uint32_t lo) {
+    return static_cast<double>(((static_cast<uint64_t>(hi) << 32) | lo) >> 11) * 0x1.0p-53;
+}
+
+// values: cantidad de claves distintas posibles (0 = sin límite, flotantes)
+inline Fraction position(Distribution dist, uint64_t index, uint64_t n, uint64_t values, uint64_t seed) {
+    Philox4x32 r = philox4x32_10(index, seed);
+    const unsigned __int128 REAL = (unsigned __int128)1 << 53;
+    switch (dist) {
+        case Distribution::SORTED:
+            return {index, n};
+        case Distribution::REVERSE:
+            return {n - 1 - index, n};
+        case Distribution::NEARLY_SORTED:
+            if (unit_real(r.v[0], r.v[1]) < NEARLY_SORTED_NOISE) {
+                return {(unsigned __int128)(unit_real(r.v[2], r.v[3]) * 0x1.0p53), REAL};
+            }
+            return {index, n};
+        case Distribution::FEW_UNIQUE:
+            return {r.v[0] % FEW_UNIQUE_VALUES, FEW_UNIQUE_VALUES};
+        case Distribution::GAUSSIAN: {
+            // Box-Muller con dos reales en (0, 1]
+            double u1 = 1.0 - unit_real(r.v[0], r.v[1]);
+            double u2 = unit_real(r.v[2], r.v[3]);
+            double z = std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * M_PI * u2);
+            double t = std::fmin(std::fmax(0.5 + z / 8.0, 0.0), 1.0 - 0x1.0p-53);
+            return {(unsigned __int128)(t * 0x1.0p53), REAL};
+        }
+        case Distribution::ZIPF: {
+            // Inversa de la CDF continua de x^-s sobre [1, m + 1): r = floor(x)
+            uint64_t m = (values > 0 && values < ZIPF_VALUES) ? values : ZIPF_VALUES;
+            double u = unit_real(r.v[0], r.v[1]);
+            double a = 1.0 - ZIPF_EXPONENT;
+            double x = std::pow(1.0 + u * (std::pow(m + 1.0, a) - 1.0), 1.0 / a);
+            uint64_t rank = std::min<uint64_t>(static_cast<uint64_t>(x), m);
+            return {rank - 1, m};
+        }
+        default:
+            return {0, 1};
+    }
+}
+
+}  // namespace dist_detail
+
+// Como philox_fill, para el arreglo global de n elementos con la forma dist
+template <typename Key>
+void distribution_fill(Key* out, uint64_t begin, size_t count, uint64_t n,
+                       Key min_val, Key max_val, uint64_t seed, Distribution dist) {
+    if (dist == Distribution::UNIFORM) {
+        philox_fill(out, begin, count, min_val, max_val, seed);
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if constexpr (std::is_floating_point_v<Key>) {
+            dist_detail::Fraction f = dist_detail::position(dist, begin + i, n, 0, seed);
+            double t = static_cast<double>(f.num) / static_cast<double>(f.den);
+            out[i] = static_cast<Key>(min_val + (static_cast<double>(max_val) - min_val) * t);
+        } else {
+            // Rango como entero sin signo (0 = 2^64, todo int64)
+            uint64_t range = static_cast<uint64_t>(max_val) - static_cast<uint64_t>(min_val) + 1;
+            unsigned __int128 span = range ? range : (unsigned __int128)1 << 64;
+            dist_detail::Fraction f = dist_detail::position(dist, begin + i, n, range, seed);
+            uint64_t offset = static_cast<uint64_t>(f.num * span / f.den);
+            out[i] = static_cast<Key>(static_cast<uint64_t>(min_val) + offset);
+        }
+    }
+}
+
+// Flujo sin fin para la ventana deslizante (--window): las posiciones [0, n)
+// son el arreglo de distribution_fill y cada tramo siguiente de n repite la
+// forma con la semilla siguiente
+template <typename Key>
+void stream_fill(Key* out, uint64_t begin, size_t count, uint64_t n,
+                 Key min_val, Key max_val, uint64_t seed, Distribution dist) {
+    for (size_t i = 0; i < count;) {
+        uint64_t pos = begin + i;
+        size_t run = std::min<uint64_t>(count - i, n - pos % n);
+        distribution_fill(out + i, pos % n, run, n, min_val, max_val, seed + pos / n, dist);
+        i += run;
+    }
+}
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef HISTOGRAM_RANKING_H
+#define HISTOGRAM_RANKING_H
+
+#include <vector>
+#include <cstddef>
+#include <type_traits>
+#include <unistd.h>
+
+// ===== RANKING POR DOMINIO DE VALORES (HISTOGRAMA + PREFIJO) =====
+// Cuando el rango [min, max] es pequeño, el ranking no necesita comparaciones:
+// con el histograma global hist[v - min] y su suma prefija inclusiva, la
+// cantidad de elementos <= v es prefix[v - min], que se lee en O(1).
+
+// Presupuesto de caché para el histograma: L2 del sistema (1 MiB si no se conoce)
+inline size_t histogram_cache_budget() {
+    long l2 = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    return l2 > 0 ? static_cast<size_t>(l2) : (size_t(1) << 20);
+}
+
+// Tope de --engine histogram pedido explícitamente: 2^26 valores (256 MiB de
+// conteos int por proceso); más no entra en memoria
+const double HISTOGRAM_MAX_VALUES = double(1 << 26);
+
+// Cantidad de valores de [min, max], en double (con int64 puede no caber en
+// long long y con int max - min + 1 desborda)
+template <typename Key>
+double histogram_range(Key min_val, Key max_val) {
+    return (double)max_val - (double)min_val + 1;
+}
+
+// ¿Se puede usar el motor histograma? Solo claves enteras y rango bajo el tope
+template <typename Key>
+bool histogram_range_fits(Key min_val, Key max_val) {
+    return std::is_integral_v<Key> && histogram_range(min_val, max_val) <= HISTOGRAM_MAX_VALUES;
+}
+
+// Selección automática: el histograma cabe en caché y el rango no supera la
+// cantidad de elementos que procesa cada proceso (si no, ordenar es más barato).
+template <typename Key>
+bool histogram_engine_fits(Key min_val, Key max_val, long long elements) {
+    if (!std::is_integral_v<Key>) return false;
+    double range = histogram_range(min_val, max_val);
+    return range * sizeof(int) <= (double)histogram_cache_budget()
+        && range <= (double)elements;
+}
+
+// Key es el tipo de las claves (entero) y Count el de los conteos (int, o
+// int64_t cuando N no cabe en int)
+
+// hist debe tener tamaño max - min + 1; se acumula sobre lo que ya contenga
+template <typename Key, typename Count>
+void histogram_count(const Key* data, size_t n, Key min_val, std::vector<Count>& hist) {
+    static_assert(std::is_integral_v<Key>, "el histograma requiere claves enteras");
+    for (size_t i = 0; i < n; i++) {
+        hist[data[i] - min_val]++;
+    }
+}
+
+// Convierte el histograma en suma prefija inclusiva (in-place)
+template <typename Count>
+void histogram_prefix(std::vector<Count>& hist) {
+    Count running = 0;
+    for (Count& count : hist) {
+        running += count;
+        count = running;
+    }
+}
+
+// ranking[i] = prefix[data[i] - min]
+template <typename Key, typename Count>
+void histogram_lookup(const Key* data, size_t n, Key min_val,
+                      const std::vector<Count>& prefix, Count* ranking) {
+    static_assert(std::is_integral_v<Key>, "el histograma requiere claves enteras");
+    for (size_t i = 0; i < n; i++) {
+        ranking[i] = prefix[data[i] - min_val];
+    }
+}
+
+#endif
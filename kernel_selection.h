@@ -0,0 +1,76 @@
+#ifndef KERNEL_SELECTION_H
+#define KERNEL_SELECTION_H
+
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+
+// ===== SELECCIÓN ADAPTATIVA DE KERNELS =====
+// Con --sort auto / --ranking auto cada proceso mira una muestra de su bloque
+// antes del sort y elige los kernels para esa forma de datos. La muestra son
+// SHAPE_SAMPLE pares de elementos vecinos tomados con paso fijo (cuántos suben
+// y cuántos bajan) y los mismos elementos ordenados (cuántos valores
+// distintos): O(SHAPE_SAMPLE log SHAPE_SAMPLE), independiente del bloque.
+//
+// Reglas medidas con claves int, bloques de 4K a 4M elementos:
+//   sort:    ordenada o inversa -> std (introsort casi lineal sobre tramos
+//            monótonos); el resto -> radix, salvo bloques chicos
+//   ranking: ordenada o inversa -> merge (las consultas llegan casi en orden
+//            y el recorrido lineal no tiene fallos de caché); el resto ->
+//            index (Eytzinger), que le gana a bsearch en todas las formas
+
+enum class DataShape { RANDOM, SORTED, REVERSE, NEARLY_SORTED, FEW_UNIQUE };
+
+const size_t SHAPE_SAMPLE = 1024;
+const size_t RADIX_AUTO_MIN = 4096;       // por debajo std::sort es igual o mejor
+const int NEARLY_SORTED_DISORDER = 10;    // casi ordenada: <= 1/10 de pares al revés
+const int FEW_UNIQUE_RATIO = 16;          // pocos valores: distintos <= muestra / 16
+
+inline const char* data_shape_name(DataShape shape) {
+    switch (shape) {
+        case DataShape::SORTED: return "ordenada";
+        case DataShape::REVERSE: return "inversa";
+        case DataShape::NEARLY_SORTED: return "casi ordenada";
+        case DataShape::FEW_UNIQUE: return "pocos valores";
+        default: return "aleatoria";
+    }
+}
+
+template <typename Key>
+DataShape sample_shape(const Key* data, size_t n) {
+    if (n < 2) return DataShape::SORTED;
+    size_t pairs = std::min(SHAPE_SAMPLE, n - 1);
+    size_t stride = (n - 1) / pairs;
+    size_t ascending = 0, descending = 0;
+    std::vector<Key> sample(pairs);
+    for (size_t s = 0; s < pairs; s++) {
+        size_t i = s * stride;
+        if (data[i] < data[i + 1]) ascending++;
+        if (data[i + 1] < data[i]) descending++;
+        sample[s] = data[i];
+    }
+    std::sort(sample.begin(), sample.end());
+    size_t distinct = std::unique(sample.begin(), sample.end()) - sample.begin();
+
+    // Los iguales no cuentan para el orden (sorted con rango < N repite valores)
+    if (ascending > 0 && descending == 0) return DataShape::SORTED;
+    if (descending > 0 && ascending == 0) return DataShape::REVERSE;
+    if (distinct * FEW_UNIQUE_RATIO <= pairs) return DataShape::FEW_UNIQUE;
+    if (std::min(ascending, descending) * NEARLY_SORTED_DISORDER <= ascending + descending) {
+        return DataShape::NEARLY_SORTED;
+    }
+    return DataShape::RANDOM;
+}
+
+// Sort de n elementos con esa forma: radix (true) o std::sort (false)
+inline bool prefer_radix(DataShape shape, size_t n) {
+    if (shape == DataShape::SORTED || shape == DataShape::REVERSE) return false;
+    return n >= RADIX_AUTO_MIN;
+}
+
+// Ranking: merge (true) o índice Eytzinger (false)
+inline bool prefer_merge(DataShape shape) {
+    return shape == DataShape::SORTED || shape == DataShape::REVERSE;
+}
+
+#endif
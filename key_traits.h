@@ -0,0 +1,116 @@
+#ifndef KEY_TRAITS_H
+#define KEY_TRAITS_H
+
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+
+// ===== TIPOS DE CLAVE =====
+// Todo lo que el motor necesita saber del tipo de los elementos, resuelto en
+// compilación (el tipo MPI está junto al resto del código MPI):
+//   Ordered      entero sin signo del mismo ancho que la clave
+//   ordered(v)   biyección que preserva el orden: a < b  <=>  ordered(a) < ordered(b)
+//                (la usan el radix sort y las claves (valor, índice) del ranking)
+//   from_ordered inversa de ordered
+//   bits         la misma transformación sin normalizar -0.0: biyección exacta,
+//                para codificar sin pérdida (from_bits es su inversa)
+//   predecessor  mayor valor < v, para contar "< v" como "<= predecessor(v)";
+//                has_predecessor(v) es falso para el mínimo del tipo
+//   parse        lee un valor de la línea de comandos (false si no es válido)
+// En punto flotante -0.0 se trata igual que +0.0 y NaN no se admite (no tiene orden).
+
+namespace key_detail {
+
+// Enteros con signo: XOR del bit de signo
+template <typename Key, typename Unsigned>
+struct IntegralKey {
+    using Ordered = Unsigned;
+    static constexpr Unsigned SIGN = std::is_signed_v<Key> ? Unsigned(Unsigned(1) << (8 * sizeof(Key) - 1)) : 0;
+
+    static Ordered ordered(Key value) { return static_cast<Unsigned>(value) ^ SIGN; }
+    static Key from_ordered(Ordered key) { return static_cast<Key>(static_cast<Unsigned>(key ^ SIGN)); }
+    static Ordered bits(Key value) { return ordered(value); }
+    static Key from_bits(Ordered key) { return from_ordered(key); }
+
+    static bool has_predecessor(Key value) { return value != std::numeric_limits<Key>::min(); }
+    static Key predecessor(Key value) { return value - 1; }
+
+    static bool parse(const char* text, Key& value) {
+        char* end;
+        errno = 0;
+        long long parsed = strtoll(text, &end, 10);
+        if (*end != '\0' || end == text || errno == ERANGE) return false;
+        if (parsed < (long long)std::numeric_limits<Key>::min() ||
+            parsed > (long long)std::numeric_limits<Key>::max()) return false;
+        value = static_cast<Key>(parsed);
+        return true;
+    }
+};
+
+// IEEE 754: los positivos invierten el bit de signo, los negativos todos los bits
+template <typename Key, typename Unsigned>
+struct FloatingKey {
+    using Ordered = Unsigned;
+    static constexpr Unsigned SIGN = Unsigned(1) << (8 * sizeof(Key) - 1);
+
+    static Ordered bits(Key value) {
+        Unsigned raw;
+        memcpy(&raw, &value, sizeof(Key));
+        return (raw & SIGN) ? ~raw : (raw ^ SIGN);
+    }
+    static Key from_bits(Ordered key) {
+        Unsigned raw = (key & SIGN) ? (key ^ SIGN) : ~key;
+        Key value;
+        memcpy(&value, &raw, sizeof(Key));
+        return value;
+    }
+    static Ordered ordered(Key value) { return bits(value == 0 ? Key(0) : value); }  // -0.0 -> +0.0
+    static Key from_ordered(Ordered key) { return from_bits(key); }
+
+    static bool has_predecessor(Key value) { return value != -std::numeric_limits<Key>::infinity(); }
+    static Key predecessor(Key value) { return std::nextafter(value, -std::numeric_limits<Key>::infinity()); }
+
+    static bool parse(const char* text, Key& value) {
+        char* end;
+        double parsed = strtod(text, &end);
+        if (*end != '\0' || end == text || std::isnan(parsed)) return false;
+        value = static_cast<Key>(parsed);
+        return std::isfinite(value);
+    }
+};
+
+}  // namespace key_detail
+
+template <typename Key>
+struct KeyTraits;
+
+template <>
+struct KeyTraits<char> : key_detail::IntegralKey<char, uint8_t> {
+    static constexpr const char* name = "char";
+};
+
+template <>
+struct KeyTraits<int> : key_detail::IntegralKey<int, uint32_t> {
+    static constexpr const char* name = "int32";
+};
+
+template <>
+struct KeyTraits<int64_t> : key_detail::IntegralKey<int64_t, uint64_t> {
+    static constexpr const char* name = "int64";
+};
+
+template <>
+struct KeyTraits<float> : key_detail::FloatingKey<float, uint32_t> {
+    static constexpr const char* name = "float";
+};
+
+template <>
+struct KeyTraits<double> : key_detail::FloatingKey<double, uint64_t> {
+    static constexpr const char* name = "double";
+};
+
+#endif
@@ -0,0 +1,350 @@
+#ifndef ORDER_STAT_TREE_H
+#define ORDER_STAT_TREE_H
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+// ===== ÁRBOL DE ESTADÍSTICOS DE ORDEN (RANKING DINÁMICO) =====
+// Multiconjunto de claves con inserción, borrado, # <= v / # < v y la k-ésima
+// menor en O(log n), para mantener rankings cuando llegan o vencen unas pocas
+// claves sin recalcular todo. Es un B+ con nodos planos en dos vectores
+// (índices en lugar de punteros):
+//   hoja     hasta LEAF_CAP claves ordenadas (256 bytes con int)
+//   interno  hasta FANOUT hijos con la menor clave de cada uno (first) y la
+//            cantidad de claves de su subárbol (count)
+// El hijo i tiene claves en [first[i], first[i + 1]]: los iguales pueden
+// cruzar el borde, pero la última i con first[i] <= v siempre contiene a v si
+// v está. # <= v suma los count de los hijos anteriores a esa i y baja por
+// ella: un nodo por nivel, sin recorrer hojas vecinas.
+// Los nodos que se vacían se liberan pero no se fusionan con sus vecinos: la
+// altura queda acotada por el tamaño máximo alcanzado (una ventana deslizante
+// mantiene el tamaño estable).
+
+template <typename Key>
+class OrderStatTree {
+public:
+    static const int LEAF_CAP = 64;
+    static const int FANOUT = 32;
+
+    OrderStatTree() { clear(); }
+
+    void clear() {
+        leaves_.clear();
+        inners_.clear();
+        free_leaves_.clear();
+        free_inners_.clear();
+        root_ = new_leaf();
+        height_ = 0;
+        size_ = 0;
+    }
+
+    int64_t size() const { return size_; }
+    int height() const { return height_; }
+
+    // Carga en O(n) desde claves ordenadas, con nodos al 3/4 para que las
+    // primeras inserciones no partan
+    void build(const std::vector<Key>& sorted) {
+        clear();
+        if (sorted.empty()) return;
+        const size_t leaf_fill = LEAF_CAP * 3 / 4, inner_fill = FANOUT * 3 / 4;
+
+        std::vector<int32_t> level;
+        std::vector<int64_t> counts;
+        std::vector<Key> firsts;
+        leaves_.clear();
+        for (size_t begin = 0; begin < sorted.size(); begin += leaf_fill) {
+            size_t end = std::min(sorted.size(), begin + leaf_fill);
+            int32_t leaf = new_leaf();
+            Leaf& node = leaves_[leaf];
+            node.size = end - begin;
+            std::copy(sorted.begin() + begin, sorted.begin() + end, node.keys);
+            level.push_back(leaf);
+            counts.push_back(end - begin);
+            firsts.push_back(sorted[begin]);
+        }
+
+        height_ = 0;
+        while (level.size() > 1) {
+            std::vector<int32_t> parents;
+            std::vector<int64_t> parent_counts;
+            std::vector<Key> parent_firsts;
+            for (size_t begin = 0; begin < level.size(); begin += inner_fill) {
+                size_t end = std::min(level.size(), begin + inner_fill);
+                int32_t inner = new_inner();
+                Inner& node = inners_[inner];
+                node.size = end - begin;
+                int64_t total = 0;
+                for (size_t i = begin; i < end; i++) {
+                    node.child[i - begin] = level[i];
+                    node.count[i - begin] = counts[i];
+                    node.first[i - begin] = firsts[i];
+                    total += counts[i];
+                }
+                parents.push_back(inner);
+                parent_counts.push_back(total);
+                parent_firsts.push_back(firsts[begin]);
+            }
+            level.swap(parents);
+            counts.swap(parent_counts);
+            firsts.swap(parent_firsts);
+            height_++;
+        }
+        root_ = level[0];
+        size_ = sorted.size();
+    }
+
+    // # <= key
+    int64_t count_le(Key key) const { return count(key, false); }
+
+    // # < key
+    int64_t count_less(Key key) const { return count(key, true); }
+
+    // k-ésima menor (0 <= k < size)
+    Key select(int64_t k) const {
+        int32_t node = root_;
+        for (int level = height_; level > 0; level--) {
+            const Inner& inner = inners_[node];
+            int i = 0;
+            while (k >= inner.count[i]) k -= inner.count[i++];
+            node = inner.child[i];
+        }
+        return leaves_[node].keys[k];
+    }
+
+    void insert(Key key) {
+        PathStep path[MAX_HEIGHT];
+        int32_t node = root_;
+        for (int level = height_; level > 0; level--) {
+            Inner& inner = inners_[node];
+            int i = route(inner, key, false);
+            if (i < 0) {
+                i = 0;
+                inner.first[0] = key;  // nueva mínima del subárbol
+            }
+            inner.count[i]++;
+            path[level - 1] = {node, i};
+            node = inner.child[i];
+        }
+
+        Leaf& leaf = leaves_[node];
+        int pos = std::upper_bound(leaf.keys, leaf.keys + leaf.size, key) - leaf.keys;
+        std::copy_backward(leaf.keys + pos, leaf.keys + leaf.size, leaf.keys + leaf.size + 1);
+        leaf.keys[pos] = key;
+        leaf.size++;
+        size_++;
+        if (leaf.size > LEAF_CAP) split_leaf(node, path);
+    }
+
+    // Borra una aparición de key; false si no está
+    bool erase(Key key) {
+        PathStep path[MAX_HEIGHT];
+        int32_t node = root_;
+        for (int level = height_; level > 0; level--) {
+            const Inner& inner = inners_[node];
+            int i = route(inner, key, false);
+            if (i < 0) return false;
+            path[level - 1] = {node, i};
+            node = inner.child[i];
+        }
+
+        Leaf& leaf = leaves_[node];
+        int pos = std::lower_bound(leaf.keys, leaf.keys + leaf.size, key) - leaf.keys;
+        if (pos == leaf.size || key < leaf.keys[pos]) return false;
+        std::copy(leaf.keys + pos + 1, leaf.keys + leaf.size, leaf.keys + pos);
+        leaf.size--;
+        size_--;
+        for (int level = 0; level < height_; level++) inners_[path[level].node].count[path[level].index]--;
+
+        if (leaf.size == 0 && height_ > 0) {
+            remove_child(path, 0);
+            free_leaves_.push_back(node);
+        } else if (pos == 0 && leaf.size > 0) {
+            update_first(path, 0, leaf.keys[0]);
+        }
+        return true;
+    }
+
+private:
+    static const int MAX_HEIGHT = 16;  // FANOUT^16 claves: nunca se alcanza
+
+    // Un elemento más de capacidad: se inserta y después se parte
+    struct Leaf {
+        int size;
+        Key keys[LEAF_CAP + 1];
+    };
+
+    struct Inner {
+        int size;
+        Key first[FANOUT + 1];
+        int64_t count[FANOUT + 1];
+        int32_t child[FANOUT + 1];
+    };
+
+    // Nodo interno del nivel y el hijo por el que se bajó
+    struct PathStep {
+        int32_t node;
+        int index;
+    };
+
+    std::vector<Leaf> leaves_;
+    std::vector<Inner> inners_;
+    std::vector<int32_t> free_leaves_, free_inners_;
+    int32_t root_;
+    int height_;  // 0: la raíz es una hoja
+    int64_t size_;
+
+    int32_t new_leaf() {
+        if (!free_leaves_.empty()) {
+            int32_t leaf = free_leaves_.back();
+            free_leaves_.pop_back();
+            leaves_[leaf].size = 0;
+            return leaf;
+        }
+        leaves_.push_back(Leaf());
+        leaves_.back().size = 0;
+        return leaves_.size() - 1;
+    }
+
+    int32_t new_inner() {
+        if (!free_inners_.empty()) {
+            int32_t inner = free_inners_.back();
+            free_inners_.pop_back();
+            inners_[inner].size = 0;
+            return inner;
+        }
+        inners_.push_back(Inner());
+        inners_.back().size = 0;
+        return inners_.size() - 1;
+    }
+
+    // Última i con first[i] <= key (first[i] < key si strict); -1 si ninguna
+    static int route(const Inner& inner, Key key, bool strict) {
+        int i = strict ? std::lower_bound(inner.first, inner.first + inner.size, key) - inner.first
+                       : std::upper_bound(inner.first, inner.first + inner.size, key) - inner.first;
+        return i - 1;
+    }
+
+    int64_t count(Key key, bool strict) const {
+        int64_t total = 0;
+        int32_t node = root_;
+        for (int level = height_; level > 0; level--) {
+            const Inner& inner = inners_[node];
+            int i = route(inner, key, strict);
+            if (i < 0) return total;
+            for (int c = 0; c < i; c++) total += inner.count[c];
+            node = inner.child[i];
+        }
+        const Leaf& leaf = leaves_[node];
+        const Key* end = strict ? std::lower_bound(leaf.keys, leaf.keys + leaf.size, key)
+                                : std::upper_bound(leaf.keys, leaf.keys + leaf.size, key);
+        return total + (end - leaf.keys);
+    }
+
+    // Inserta (first, count, child) en el nodo interno del nivel level del
+    // camino, a la derecha del hijo por el que se bajó
+    void add_sibling(PathStep* path, int level, Key first, int64_t count, int32_t child) {
+        if (level == height_) {
+            // Partió la raíz: nueva raíz con los dos
+            int32_t old_root = root_;
+            int64_t total = size_ - count;
+            Key old_first = first_key(old_root, height_);
+            int32_t root = new_inner();
+            Inner& inner = inners_[root];
+            inner.size = 2;
+            inner.child[0] = old_root;
+            inner.count[0] = total;
+            inner.first[0] = old_first;
+            inner.child[1] = child;
+            inner.count[1] = count;
+            inner.first[1] = first;
+            root_ = root;
+            height_++;
+            return;
+        }
+
+        int32_t node = path[level].node;
+        Inner& inner = inners_[node];
+        int pos = path[level].index + 1;
+        std::copy_backward(inner.first + pos, inner.first + inner.size, inner.first + inner.size + 1);
+        std::copy_backward(inner.count + pos, inner.count + inner.size, inner.count + inner.size + 1);
+        std::copy_backward(inner.child + pos, inner.child + inner.size, inner.child + inner.size + 1);
+        inner.first[pos] = first;
+        inner.count[pos] = count;
+        inner.child[pos] = child;
+        inner.count[pos - 1] -= count;
+        inner.size++;
+        if (inner.size > FANOUT) split_inner(node, path, level);
+    }
+
+    Key first_key(int32_t node, int level) const {
+        return level == 0 ? leaves_[node].keys[0] : inners_[node].first[0];
+    }
+
+    void split_leaf(int32_t node, PathStep* path) {
+        int32_t right = new_leaf();
+        Leaf& left_leaf = leaves_[node];
+        Leaf& right_leaf = leaves_[right];
+        int half = left_leaf.size / 2;
+        right_leaf.size = left_leaf.size - half;
+        std::copy(left_leaf.keys + half, left_leaf.keys + left_leaf.size, right_leaf.keys);
+        left_leaf.size = half;
+        add_sibling(path, 0, right_leaf.keys[0], right_leaf.size, right);
+    }
+
+    void split_inner(int32_t node, PathStep* path, int level) {
+        int32_t right = new_inner();
+        Inner& left_inner = inners_[node];
+        Inner& right_inner = inners_[right];
+        int half = left_inner.size / 2;
+        right_inner.size = left_inner.size - half;
+        int64_t moved = 0;
+        for (int i = half; i < left_inner.size; i++) {
+            right_inner.first[i - half] = left_inner.first[i];
+            right_inner.count[i - half] = left_inner.count[i];
+            right_inner.child[i - half] = left_inner.child[i];
+            moved += left_inner.count[i];
+        }
+        left_inner.size = half;
+        add_sibling(path, level + 1, right_inner.first[0], moved, right);
+    }
+
+    // La mínima del hijo del nivel level cambió: actualiza first hacia arriba
+    // mientras sea el primer hijo
+    void update_first(PathStep* path, int level, Key first) {
+        for (; level < height_; level++) {
+            Inner& inner = inners_[path[level].node];
+            inner.first[path[level].index] = first;
+            if (path[level].index != 0) return;
+        }
+    }
+
+    // El hijo del nivel level del camino quedó vacío: se saca del padre (que
+    // puede vaciarse a su vez) y la raíz con un solo hijo baja un nivel
+    void remove_child(PathStep* path, int level) {
+        int32_t node = path[level].node;
+        Inner& inner = inners_[node];
+        int pos = path[level].index;
+        std::copy(inner.first + pos + 1, inner.first + inner.size, inner.first + pos);
+        std::copy(inner.count + pos + 1, inner.count + inner.size, inner.count + pos);
+        std::copy(inner.child + pos + 1, inner.child + inner.size, inner.child + pos);
+        inner.size--;
+
+        // La raíz nunca se vacía (con un solo hijo ya bajó): aquí hay padre
+        if (inner.size == 0) {
+            remove_child(path, level + 1);
+            free_inners_.push_back(node);
+            return;
+        }
+        if (pos == 0) update_first(path, level + 1, inner.first[0]);
+
+        while (height_ > 0 && inners_[root_].size == 1) {
+            free_inners_.push_back(root_);
+            root_ = inners_[root_].child[0];
+            height_--;
+        }
+    }
+};
+
+#endif
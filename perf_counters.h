@@ -0,0 +1,166 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <vector>
+
+// ===== CONTADORES DE RENDIMIENTO (perf_event_open) =====
+// Ciclos, instrucciones, fallos de LLC, fallos de predicción de saltos y
+// fallos de página, contados solo en espacio de usuario. Cada contador se
+// abre por hilo (perf_event_open cuenta el hilo que lo abre): el hilo
+// principal con add_current_thread() y los workers del pool igual, al
+// arrancar; read() suma todos los hilos. Con inherit también se cuentan los
+// hilos que se crean después y terminan antes de leer (p. ej. los del radix
+// sort secuencial).
+//
+// Sin contadores de hardware (máquinas virtuales, contenedores,
+// perf_event_paranoid alto) cada contador cae a su alternativa por software:
+//   ciclos           -> task-clock de perf (ns de CPU)
+//   fallos de página -> evento software de perf
+//   instrucciones, fallos de LLC y de saltos no tienen alternativa
+// y si perf_event_open no está disponible en absoluto, ns de CPU y fallos de
+// página salen de clock_gettime/getrusage del proceso (todos los hilos).
+
+enum PerfCounter {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_LLC_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_PAGE_FAULTS,
+    PERF_COUNTERS
+};
+
+// Origen de cada contador. RUSAGE y SOFTWARE miden lo mismo (ns de CPU en
+// lugar de ciclos); NONE: sin valor
+enum class CounterSource { HARDWARE, SOFTWARE, RUSAGE, NONE };
+
+struct PerfCounterInfo {
+    const char* label;     // encabezado de tabla
+    const char* csv_name;
+    uint32_t type;         // evento principal
+    uint64_t config;
+    int32_t fallback_type; // evento software alternativo, o -1
+    uint64_t fallback_config;
+};
+
+const PerfCounterInfo PERF_COUNTER_INFO[PERF_COUNTERS] = {
+    {"ciclos", "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,
+     PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+    {"instrucc.", "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, -1, 0},
+    {"fallos LLC", "llc_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, -1, 0},
+    {"fallos salto", "branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, -1, 0},
+    {"fallos pág.", "page_faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, -1, 0},
+};
+
+inline const char* counter_source_name(CounterSource source) {
+    switch (source) {
+        case CounterSource::HARDWARE: return "hw";
+        case CounterSource::SOFTWARE: return "sw";
+        case CounterSource::RUSAGE: return "rusage";
+        default: return "n/d";
+    }
+}
+
+class PerfCounters {
+public:
+    PerfCounters() {
+        for (CounterSource& source : sources_) source = CounterSource::NONE;
+    }
+
+    ~PerfCounters() {
+        for (auto& fds : fds_) {
+            for (int fd : fds) close(fd);
+        }
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // Abre los contadores para el hilo que llama. La primera llamada decide
+    // el origen de cada contador; los demás hilos abren el mismo evento.
+    void add_current_thread() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (int c = 0; c < PERF_COUNTERS; c++) {
+            const PerfCounterInfo& info = PERF_COUNTER_INFO[c];
+            if (!probed_) {
+                CounterSource native = info.type == PERF_TYPE_HARDWARE ? CounterSource::HARDWARE
+                                                                       : CounterSource::SOFTWARE;
+                if (try_open(c, info.type, info.config)) {
+                    sources_[c] = native;
+                } else if (info.fallback_type >= 0 && try_open(c, info.fallback_type, info.fallback_config)) {
+                    sources_[c] = CounterSource::SOFTWARE;
+                } else if (c == PERF_CYCLES || c == PERF_PAGE_FAULTS) {
+                    sources_[c] = CounterSource::RUSAGE;
+                }
+            } else if (sources_[c] == CounterSource::HARDWARE) {
+                try_open(c, info.type, info.config);
+            } else if (sources_[c] == CounterSource::SOFTWARE) {
+                bool native = info.type == PERF_TYPE_SOFTWARE;
+                try_open(c, native ? info.type : info.fallback_type,
+                         native ? info.config : info.fallback_config);
+            }
+        }
+        probed_ = true;
+    }
+
+    CounterSource source(int counter) const { return sources_[counter]; }
+
+    // Valores acumulados (suma de los hilos, escalados si el kernel multiplexó)
+    void read(double* values) const {
+        for (int c = 0; c < PERF_COUNTERS; c++) {
+            values[c] = 0;
+            if (sources_[c] == CounterSource::RUSAGE) {
+                values[c] = process_fallback(c);
+                continue;
+            }
+            for (int fd : fds_[c]) {
+                uint64_t data[3];  // valor, tiempo habilitado, tiempo corriendo
+                if (::read(fd, data, sizeof(data)) != sizeof(data) || data[2] == 0) continue;
+                values[c] += (double)data[0] * ((double)data[1] / data[2]);
+            }
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    bool probed_ = false;
+    CounterSource sources_[PERF_COUNTERS];
+    std::vector<int> fds_[PERF_COUNTERS];
+
+    bool try_open(int counter, uint32_t type, uint64_t config) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.inherit = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        int fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+        if (fd < 0) return false;
+        fds_[counter].push_back(fd);
+        return true;
+    }
+
+    // Sin perf_event_open: ns de CPU y fallos de página de todo el proceso
+    static double process_fallback(int counter) {
+        if (counter == PERF_CYCLES) {
+            timespec ts;
+            clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+            return ts.tv_sec * 1e9 + ts.tv_nsec;
+        }
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return (double)usage.ru_minflt + usage.ru_majflt;
+    }
+};
+
+#endif
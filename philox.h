@@ -0,0 +1,115 @@
+#ifndef PHILOX_H
+#define PHILOX_H
+
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+
+// ===== GENERADOR BASADO EN CONTADOR (PHILOX4x32-10) =====
+// Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3" (SC'11).
+// El valor del elemento i depende solo de (seed, i): cualquier proceso puede
+// generar cualquier tramo del arreglo global sin generar lo anterior, y el
+// resultado es idéntico bit a bit al de un único generador recorriendo 0..N-1.
+
+struct Philox4x32 {
+    uint32_t v[4];
+};
+
+inline Philox4x32 philox4x32_10(uint64_t counter, uint64_t key) {
+    const uint32_t M0 = 0xD2511F53u, M1 = 0xCD9E8D57u;
+    const uint32_t W0 = 0x9E3779B9u, W1 = 0xBB67AE85u;
+
+    uint32_t c0 = static_cast<uint32_t>(counter);
+    uint32_t c1 = static_cast<uint32_t>(counter >> 32);
+    uint32_t c2 = 0, c3 = 0;
+    uint32_t k0 = static_cast<uint32_t>(key);
+    uint32_t k1 = static_cast<uint32_t>(key >> 32);
+
+    for (int round = 0; round < 10; round++) {
+        uint64_t p0 = static_cast<uint64_t>(M0) * c0;
+        uint64_t p1 = static_cast<uint64_t>(M1) * c2;
+        uint32_t n0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n1 = static_cast<uint32_t>(p1);
+        uint32_t n2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+        uint32_t n3 = static_cast<uint32_t>(p0);
+        c0 = n0; c1 = n1; c2 = n2; c3 = n3;
+        k0 += W0;
+        k1 += W1;
+    }
+
+    return {{c0, c1, c2, c3}};
+}
+
+// Entero uniforme en [min_val, max_val] para el elemento index.
+// Reducción de Lemire con rechazo: cada contador aporta 4 palabras candidatas;
+// si las 4 se rechazan (probabilidad < (rango/2^32)^4) se usa la última.
+inline int philox_uniform_int(uint64_t index, int min_val, int max_val, uint64_t seed) {
+    Philox4x32 r = philox4x32_10(index, seed);
+    uint64_t range = static_cast<uint64_t>(static_cast<int64_t>(max_val) - min_val) + 1;
+    if (range > 0xFFFFFFFFull) {
+        return static_cast<int>(r.v[0]);  // rango completo de 32 bits
+    }
+
+    uint32_t threshold = static_cast<uint32_t>((0x100000000ull - range) % range);
+    uint64_t m = 0;
+    for (int w = 0; w < 4; w++) {
+        m = static_cast<uint64_t>(r.v[w]) * range;
+        if (static_cast<uint32_t>(m) >= threshold) break;
+    }
+    return static_cast<int>(min_val + static_cast<int64_t>(m >> 32));
+}
+
+// Versión de 64 bits: con rango de hasta 2^32 da lo mismo que philox_uniform_int
+// (la misma clave sale igual con --key int y --key int64); si no, Lemire sobre
+// las dos palabras de 64 bits del contador
+inline int64_t philox_uniform_int64(uint64_t index, int64_t min_val, int64_t max_val, uint64_t seed) {
+    Philox4x32 r = philox4x32_10(index, seed);
+    uint64_t range = static_cast<uint64_t>(max_val) - static_cast<uint64_t>(min_val) + 1;
+    uint64_t m = 0;
+    if (range != 0 && range <= 0x100000000ull) {
+        uint32_t threshold = static_cast<uint32_t>((0x100000000ull - range) % range);
+        for (int w = 0; w < 4; w++) {
+            m = static_cast<uint64_t>(r.v[w]) * range;
+            if (static_cast<uint32_t>(m) >= threshold) break;
+        }
+        return static_cast<int64_t>(static_cast<uint64_t>(min_val) + (m >> 32));
+    }
+
+    uint64_t words[2] = {(static_cast<uint64_t>(r.v[1]) << 32) | r.v[0],
+                         (static_cast<uint64_t>(r.v[3]) << 32) | r.v[2]};
+    if (range == 0) return static_cast<int64_t>(words[0]);  // rango completo de 64 bits
+
+    uint64_t threshold = (0 - range) % range;
+    unsigned __int128 wide = 0;
+    for (int w = 0; w < 2; w++) {
+        wide = static_cast<unsigned __int128>(words[w]) * range;
+        if (static_cast<uint64_t>(wide) >= threshold) break;
+    }
+    return static_cast<int64_t>(static_cast<uint64_t>(min_val) + static_cast<uint64_t>(wide >> 64));
+}
+
+// Real uniforme en [min_val, max_val) con 53 bits aleatorios
+inline double philox_uniform_real(uint64_t index, double min_val, double max_val, uint64_t seed) {
+    Philox4x32 r = philox4x32_10(index, seed);
+    uint64_t bits = ((static_cast<uint64_t>(r.v[1]) << 32) | r.v[0]) >> 11;
+    return min_val + (max_val - min_val) * (static_cast<double>(bits) * 0x1.0p-53);
+}
+
+// Genera los elementos globales [begin, begin + count) en out. Key es el tipo
+// de clave: char e int usan philox_uniform_int, int64_t la versión de 64 bits
+// y float/double philox_uniform_real.
+template <typename Key>
+void philox_fill(Key* out, uint64_t begin, size_t count,
+                 Key min_val, Key max_val, uint64_t seed) {
+    for (size_t i = 0; i < count; i++) {
+        if constexpr (std::is_floating_point_v<Key>) {
+            out[i] = static_cast<Key>(philox_uniform_real(begin + i, min_val, max_val, seed));
+        } else if constexpr (sizeof(Key) > sizeof(int)) {
+            out[i] = philox_uniform_int64(begin + i, min_val, max_val, seed);
+        } else {
+            out[i] = static_cast<Key>(philox_uniform_int(begin + i, min_val, max_val, seed));
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+#include "key_traits.h"
+
+// ===== RADIX SORT LSD PARA CUALQUIER TIPO DE CLAVE =====
+// Transformación de clave: key = ordered(x) - ordered(min(data)) en el entero
+// sin signo del ancho de la clave (ver key_traits.h). Preserva el orden
+// (también con negativos y punto flotante) y deja en cero los bits altos que no
+// varían, así que solo se recorren los dígitos necesarios para el rango real:
+// una pasada para char, hasta 3 para 32 bits y hasta 6 para 64 bits.
+// Cada pasada usa buffers de write-combining por cubeta (una línea de 64 bytes)
+// que se vuelcan completos al destino, en vez de escrituras dispersas sueltas.
+
+namespace radix_detail {
+
+const int MAX_DIGIT_BITS = 11;          // 2048 cubetas: buffers WC de 128 KB (L2)
+
+// Ejecuta fn(t) para t en [0, threads); con 1 hilo no crea threads
+template <typename Fn>
+void run_threads(int threads, Fn fn) {
+    if (threads <= 1) {
+        fn(0);
+        return;
+    }
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (int t = 1; t < threads; t++) workers.emplace_back(fn, t);
+    fn(0);
+    for (auto& w : workers) w.join();
+}
+
+// Dígito de value en la pasada actual
+template <typename T>
+inline size_t digit(T value, typename KeyTraits<T>::Ordered base, int shift, size_t mask) {
+    using Ordered = typename KeyTraits<T>::Ordered;
+    return (static_cast<Ordered>(KeyTraits<T>::ordered(value) - base) >> shift) & mask;
+}
+
+// Dispersa src[begin, end) en dst según el dígito (key >> shift) & mask.
+// offsets[b] es la próxima posición libre de la cubeta b y se actualiza.
+template <typename T>
+void scatter_wc(const T* src, T* dst, size_t begin, size_t end,
+                typename KeyTraits<T>::Ordered base, int shift, size_t mask, size_t* offsets) {
+    const size_t LINE = 64 / sizeof(T);  // claves por línea de caché
+    size_t buckets = mask + 1;
+    // Una línea extra para poder alinear el inicio a 64 bytes
+    std::vector<T> storage((buckets + 1) * LINE);
+    uintptr_t aligned = (reinterpret_cast<uintptr_t>(storage.data()) + 63) & ~uintptr_t(63);
+    T* buffer = reinterpret_cast<T*>(aligned);
+    std::vector<uint8_t> fill(buckets, 0);
+
+    for (size_t i = begin; i < end; i++) {
+        T value = src[i];
+        size_t b = digit(value, base, shift, mask);
+        T* line = buffer + b * LINE;
+        line[fill[b]++] = value;
+        if (fill[b] == LINE) {
+            memcpy(dst + offsets[b], line, 64);
+            offsets[b] += LINE;
+            fill[b] = 0;
+        }
+    }
+
+    // Vaciar las líneas incompletas
+    for (size_t b = 0; b < buckets; b++) {
+        if (fill[b] > 0) {
+            memcpy(dst + offsets[b], buffer + b * LINE, fill[b] * sizeof(T));
+            offsets[b] += fill[b];
+        }
+    }
+}
+
+}  // namespace radix_detail
+
+// Ordena data in-place. threads > 1 reparte cada pasada (histograma y
+// dispersión) en bloques contiguos, uno por hilo. run(T, fn) debe ejecutar
+// fn(t) para t en [0, T) y volver cuando terminen todos (threads propios,
+// tareas de un pool, ...). low_bits: bits bajos de la clave que no se ordenan
+// (el sort es estable, así que los iguales en el resto quedan en el orden de
+// entrada; p. ej. claves (valor, índice) con el índice abajo, ya crecientes).
+template <typename T, typename Runner>
+void radix_sort_with(std::vector<T>& data, int threads, Runner run, int low_bits = 0) {
+    using namespace radix_detail;
+    using Ordered = typename KeyTraits<T>::Ordered;
+
+    size_t n = data.size();
+    if (n < 2) return;
+    threads = std::max(1, std::min<int>(threads, static_cast<int>(n / 4096) + 1));
+
+    auto [lo, hi] = std::minmax_element(data.begin(), data.end());
+    // Sin los bits bajos en la base: la resta no les pide prestado a los ordenados
+    Ordered base = KeyTraits<T>::ordered(*lo) & static_cast<Ordered>(~uint64_t(0) << low_bits);
+    uint64_t key_range = static_cast<Ordered>(KeyTraits<T>::ordered(*hi) - base);
+    if (key_range == 0) return;
+
+    // Dígitos de igual ancho (<= MAX_DIGIT_BITS) que cubren los bits del rango
+    int bits = 64 - __builtin_clzll(key_range) - low_bits;
+    if (bits <= 0) return;
+    int passes = (bits + MAX_DIGIT_BITS - 1) / MAX_DIGIT_BITS;
+    int digit_bits = (bits + passes - 1) / passes;
+    size_t mask = (size_t(1) << digit_bits) - 1;
+    size_t buckets = mask + 1;
+
+    std::vector<T> temp(n);
+    T* src = data.data();
+    T* dst = temp.data();
+
+    size_t chunk = (n + threads - 1) / threads;
+    std::vector<size_t> counts(threads * buckets);
+
+    for (int pass = 0; pass < passes; pass++) {
+        int shift = low_bits + pass * digit_bits;
+        std::fill(counts.begin(), counts.end(), 0);
+
+        // Histograma por hilo
+        run(threads, [&](int t) {
+            size_t begin = std::min(n, t * chunk);
+            size_t end = std::min(n, begin + chunk);
+            size_t* local = counts.data() + t * buckets;
+            for (size_t i = begin; i < end; i++) {
+                local[digit(src[i], base, shift, mask)]++;
+            }
+        });
+
+        // Offsets: por cubeta y dentro de ella por hilo (mantiene la estabilidad)
+        size_t running = 0;
+        bool single_bucket = false;
+        for (size_t b = 0; b < buckets; b++) {
+            size_t bucket_total = 0;
+            for (int t = 0; t < threads; t++) {
+                size_t c = counts[t * buckets + b];
+                counts[t * buckets + b] = running;
+                running += c;
+                bucket_total += c;
+            }
+            if (bucket_total == n) single_bucket = true;
+        }
+        if (single_bucket) continue;  // el dígito es igual en todos: pasada innecesaria
+
+        run(threads, [&](int t) {
+            size_t begin = std::min(n, t * chunk);
+            size_t end = std::min(n, begin + chunk);
+            scatter_wc(src, dst, begin, end, base, shift, mask, counts.data() + t * buckets);
+        });
+
+        std::swap(src, dst);
+    }
+
+    if (src != data.data()) {
+        memcpy(data.data(), src, n * sizeof(T));
+    }
+}
+
+// Versión con threads propios (creados y unidos en cada etapa)
+template <typename T>
+void radix_sort(std::vector<T>& data, int threads = 1, int low_bits = 0) {
+    radix_sort_with(data, threads, [](int count, auto fn) { radix_detail::run_threads(count, fn); }, low_bits);
+}
+
+#endif
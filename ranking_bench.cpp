@@ -0,0 +1,497 @@
+// ===== BENCHMARK: BASELINE SECUENCIAL + RANKING PARALELO EN UN SOLO LANZAMIENTO =====
+// Uso: mpirun -np P ./ranking_bench [opciones]  (ver usage)
+//
+// Dentro de un mismo mpirun corre el secuencial (rank 0, mismo binario y
+// mismos datos philox) y el ranking paralelo sobre subcomunicadores de los
+// primeros p procesos, para cada N y cada p del barrido. Cada configuración
+// hace W corridas de calentamiento y K medidas; se reporta la mediana con su
+// intervalo de confianza (estadísticos de orden, sin suponer normalidad) y se
+// escriben todas las muestras en JSON y/o CSV.
+
+#define RANKING_SORT_NO_MAIN
+#include "ranking_sort_parallel.cpp"
+#define SEQUENTIAL_NO_MAIN
+#include "sequential.cpp"
+
+#include <fstream>
+#include <sstream>
+#include <map>
+
+// ===== ESTADÍSTICA DE LAS REPETICIONES =====
+// IC de la mediana por estadísticos de orden: con K muestras ordenadas,
+// [x(l), x(K-l+1)] cubre la mediana con probabilidad 1 - 2·P(Bin(K, 1/2) < l).
+// Se usa el mayor l con cobertura >= 95%; con K < 6 no hay ninguno y el
+// intervalo es [mín, máx] con su cobertura real (level).
+struct SampleStats {
+    double median, ci_low, ci_high, level;
+    double mean, stddev, min, max;
+};
+
+SampleStats sample_stats(vector<double> samples) {
+    SampleStats stats = {};
+    size_t k = samples.size();
+    if (k == 0) return stats;
+    sort(samples.begin(), samples.end());
+    
+    stats.median = (k % 2) ? samples[k / 2] : (samples[k / 2 - 1] + samples[k / 2]) / 2;
+    stats.min = samples.front();
+    stats.max = samples.back();
+    for (double x : samples) stats.mean += x;
+    stats.mean /= k;
+    for (double x : samples) stats.stddev += (x - stats.mean) * (x - stats.mean);
+    stats.stddev = k > 1 ? sqrt(stats.stddev / (k - 1)) : 0;
+    
+    // below[l] = P(Bin(k, 1/2) < l)
+    vector<double> below(k + 1, 0);
+    double term = pow(0.5, k);  // P(Bin = 0)
+    for (size_t j = 0; j < k; j++) {
+        below[j + 1] = below[j] + term;
+        term = term * (k - j) / (j + 1);
+    }
+    size_t l = 1;
+    while (l + 1 <= k / 2 && 1 - 2 * below[l + 1] >= 0.95) l++;
+    stats.ci_low = samples[l - 1];
+    stats.ci_high = samples[k - l];
+    stats.level = 1 - 2 * below[l];
+    return stats;
+}
+
+// ===== CONFIGURACIÓN =====
+struct BenchConfig {
+    vector<long long> ns, ps;
+    string min_arg = "1", max_arg = "20000000";
+    bool weak = false;
+    int warmup = 1, reps = 5;
+    bool baseline = true;
+    string baseline_engine = "pairs";  // secuencial de los motores de comparación: pairs | same
+    string engine_arg = "auto";
+    RankingKernel ranking_kernel = RankingKernel::BSEARCH;
+    SortBackend sort_backend = SortBackend::STD;
+    Distribution dist = Distribution::UNIFORM;
+    int threads = 1;
+    bool sorted_output = false, scatter = false, compress = false, barriers = true, verify = false;
+    int pipeline_segments = 0;
+    string json_path, csv_path;
+};
+
+// Una fila del resultado: configuración + muestras (segundos)
+struct BenchResult {
+    long long N;
+    int P, rows, cols;
+    vector<double> ts, tp, compute, comm;
+};
+
+vector<long long> parse_list(const string& text) {
+    vector<long long> values;
+    stringstream in(text);
+    string item;
+    while (getline(in, item, ',')) {
+        if (!item.empty()) values.push_back(atoll(item.c_str()));
+    }
+    return values;
+}
+
+void usage(const char* program) {
+    cerr << "Uso: mpirun -np P " << program << " [opciones]\n";
+    cerr << "\nBarrido:\n";
+    cerr << "  --n LISTA       Ns separados por coma (defecto 1000000)\n";
+    cerr << "  --p LISTA       Procesos por corrida, cada uno <= P (defecto P)\n";
+    cerr << "  --scaling S     strong (defecto): todas las combinaciones N × p\n";
+    cerr << "                  weak: cada N es el de p = 1 y crece como N·sqrt(p)\n";
+    cerr << "  --min V         Valor mínimo (defecto 1)\n";
+    cerr << "  --max V         Valor máximo (defecto 20000000)\n";
+    cerr << "  --dist D        Forma de los datos: uniform (defecto) | sorted | reverse |\n";
+    cerr << "                  nearly-sorted | few-unique | gaussian | zipf\n";
+    cerr << "\nMedición:\n";
+    cerr << "  --warmup W      Corridas descartadas por configuración (defecto 1)\n";
+    cerr << "  --reps K        Corridas medidas por configuración (defecto 5; >= 6 para\n";
+    cerr << "                  un IC de la mediana del 95%)\n";
+    cerr << "  --no-baseline   No correr el secuencial (sin speedup)\n";
+    cerr << "  --baseline-engine B\n";
+    cerr << "                  pairs (defecto): el secuencial de sort es el motor pairs\n";
+    cerr << "                  (un sort de pares y un recorrido, con --sort y --threads)\n";
+    cerr << "                  same: el mismo motor y kernel de ranking que el paralelo\n";
+    cerr << "  --json F        Escribir configuración, estadísticos y muestras en F\n";
+    cerr << "  --csv F         Escribir una fila por configuración en F\n";
+    cerr << "\nMotor (igual que ranking_sort_parallel; claves int):\n";
+    cerr << "  --engine E, --ranking K, --sort S, --threads T, -s, --scatter,\n";
+    cerr << "  --pipeline S, --compress, --no-barriers, --verify (cada corrida, fuera de Tp;\n";
+    cerr << "  una falla corta el barrido)\n";
+    cerr << "  El secuencial usa el mismo sort e hilos (histogram si el motor lo es);\n";
+    cerr << "  con --baseline-engine same, --ranking merge usa bsearch y --ranking auto,\n";
+    cerr << "  index (elige el sort como un proceso)\n";
+    cerr << "\nEjemplo:\n";
+    cerr << "  mpirun -np 16 " << program << " --n 705600,1411200 --p 1,4,9,16 --reps 10 \\\n";
+    cerr << "      --json bench.json --csv bench.csv\n";
+}
+
+// Devuelve false (y avisa en rank 0) si la línea de comandos no es válida
+bool parse_bench_args(int argc, char** argv, int rank, int size, BenchConfig& config) {
+    string scaling = "strong";
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--n" && has_value) {
+            config.ns = parse_list(argv[++i]);
+        } else if (arg == "--p" && has_value) {
+            config.ps = parse_list(argv[++i]);
+        } else if (arg == "--scaling" && has_value) {
+            scaling = argv[++i];
+        } else if (arg == "--min" && has_value) {
+            config.min_arg = argv[++i];
+        } else if (arg == "--max" && has_value) {
+            config.max_arg = argv[++i];
+        } else if (arg == "--dist" && has_value) {
+            if (!parse_distribution(argv[++i], config.dist)) {
+                if (rank == 0) cerr << "ERROR: distribución desconocida: " << argv[i] << "\n";
+                return false;
+            }
+        } else if (arg == "--warmup" && has_value) {
+            config.warmup = atoi(argv[++i]);
+        } else if (arg == "--reps" && has_value) {
+            config.reps = atoi(argv[++i]);
+        } else if (arg == "--no-baseline") {
+            config.baseline = false;
+        } else if (arg == "--baseline-engine" && has_value) {
+            config.baseline_engine = argv[++i];
+        } else if (arg == "--json" && has_value) {
+            config.json_path = argv[++i];
+        } else if (arg == "--csv" && has_value) {
+            config.csv_path = argv[++i];
+        } else if (arg == "--engine" && has_value) {
+            config.engine_arg = argv[++i];
+        } else if (arg == "--ranking" && has_value) {
+            string kernel = argv[++i];
+            if (kernel == "merge") {
+                config.ranking_kernel = RankingKernel::MERGE;
+            } else if (kernel == "index") {
+                config.ranking_kernel = RankingKernel::INDEX;
+            } else if (kernel == "auto") {
+                config.ranking_kernel = RankingKernel::AUTO;
+            } else if (kernel != "bsearch") {
+                if (rank == 0) cerr << "ERROR: kernel de ranking desconocido: " << kernel << "\n";
+                return false;
+            }
+        } else if (arg == "--sort" && has_value) {
+            string backend = argv[++i];
+            if (backend == "radix") {
+                config.sort_backend = SortBackend::RADIX;
+            } else if (backend == "auto") {
+                config.sort_backend = SortBackend::AUTO;
+            } else if (backend != "std") {
+                if (rank == 0) cerr << "ERROR: sort desconocido: " << backend << "\n";
+                return false;
+            }
+        } else if (arg == "--threads" && has_value) {
+            config.threads = atoi(argv[++i]);
+        } else if (arg == "--pipeline" && has_value) {
+            config.pipeline_segments = atoi(argv[++i]);
+        } else if (arg == "-s" || arg == "--sorted") {
+            config.sorted_output = true;
+        } else if (arg == "--scatter") {
+            config.scatter = true;
+        } else if (arg == "--compress") {
+            config.compress = true;
+        } else if (arg == "--no-barriers") {
+            config.barriers = false;
+        } else if (arg == "--verify") {
+            config.verify = true;
+        } else {
+            if (rank == 0) {
+                cerr << "ERROR: opción desconocida: " << arg << "\n\n";
+                usage(argv[0]);
+            }
+            return false;
+        }
+    }
+    
+    if (config.ns.empty()) config.ns = {1000000};
+    if (config.ps.empty()) config.ps = {size};
+    config.weak = (scaling == "weak");
+    
+    const char* error = nullptr;
+    if (scaling != "strong" && scaling != "weak") error = "--scaling debe ser strong o weak";
+    if (config.warmup < 0 || config.reps < 1) error = "--warmup debe ser >= 0 y --reps >= 1";
+    if (config.threads < 1) error = "--threads debe ser >= 1";
+    if (config.pipeline_segments < 0) error = "--pipeline debe ser >= 1";
+    if (config.compress && config.pipeline_segments > 0) error = "--compress no se combina con --pipeline";
+    if (config.engine_arg != "auto" && config.engine_arg != "sort" && config.engine_arg != "histogram") {
+        error = "motor desconocido";
+    }
+    if (config.baseline_engine != "pairs" && config.baseline_engine != "same") {
+        error = "--baseline-engine debe ser pairs o same";
+    }
+    for (long long n : config.ns) {
+        if (n <= 0) error = "los N deben ser positivos";
+    }
+    for (long long p : config.ps) {
+        if (p < 1 || p > size) error = "cada p debe estar entre 1 y la cantidad de procesos lanzados";
+    }
+    if (error) {
+        if (rank == 0) cerr << "ERROR: " << error << "\n";
+        return false;
+    }
+    return true;
+}
+
+// ===== MEDICIONES =====
+// Secuencial en el proceso que llama: datos generados fuera del tiempo, como
+// en sequential.cpp. Devuelve el tiempo del ranking (segundos), que incluye
+// el muestreo con --sort auto.
+double run_sequential(const BenchConfig& config, int N, int min_val, int max_val) {
+    vector<int> data = generate_random_array(N, min_val, max_val, 42, config.dist);
+    string engine = config.engine_arg;
+    if (engine == "auto") engine = histogram_engine_fits(min_val, max_val, N) ? "histogram" : "sort";
+    if (engine == "sort" && config.baseline_engine == "pairs") engine = "pairs";
+    
+    double start = MPI_Wtime();
+    bool radix = config.sort_backend == SortBackend::RADIX;
+    if (config.sort_backend == SortBackend::AUTO) radix = prefer_radix(sample_shape(data.data(), N), N);
+    string backend = radix ? "radix" : "std";
+    vector<int> rankings;
+    if (engine == "histogram") {
+        rankings = sequential_ranking_histogram(data.data(), N, min_val, max_val);
+    } else if (engine == "pairs") {
+        rankings = sequential_ranking_pairs(data.data(), N, backend, config.threads);
+    } else if (config.ranking_kernel == RankingKernel::INDEX || config.ranking_kernel == RankingKernel::AUTO) {
+        double index_time;
+        rankings = sequential_ranking_sort_index(data.data(), N, index_time, backend, config.threads);
+    } else {
+        rankings = sequential_ranking_sort(data.data(), N, backend, config.threads);
+    }
+    return MPI_Wtime() - start;
+}
+
+// Una corrida paralela sobre comm (p procesos); en su rank 0, result recibe
+// las Metrics de la malla. Devuelve el estado de run_with_key.
+int run_parallel(const BenchConfig& bench, const Grid& grid, int rank, MPI_Comm comm,
+                 ThreadPool* pool, Metrics& result) {
+    auto [row, col] = rank_to_position(rank, grid);
+    MPI_Comm row_comm;
+    MPI_Comm_split(comm, row, col, &row_comm);
+    
+    RunConfig config = {comm, grid, -1, false, false, bench.ranking_kernel, Engine::SORT,
+                        bench.sort_backend, bench.dist, bench.threads, "", "", bench.sorted_output,
+                        bench.pipeline_segments, bench.scatter, bench.compress, bench.barriers,
+                        bench.verify, nullptr, true};
+    int status = run_with_key<int>(config, bench.engine_arg, bench.min_arg.c_str(), bench.max_arg.c_str(),
+                                   rank, row_comm, pool, &result);
+    MPI_Comm_free(&row_comm);
+    return status;
+}
+
+// ===== SALIDA =====
+void write_csv(const string& path, const BenchConfig& config, const vector<BenchResult>& results) {
+    ofstream out(path);
+    out << fixed << setprecision(3);
+    out << "scaling,N,P,rows,cols,engine,warmup,reps,"
+        << "ts_median_ms,ts_ci_low_ms,ts_ci_high_ms,"
+        << "tp_median_ms,tp_ci_low_ms,tp_ci_high_ms,tp_mean_ms,tp_stddev_ms,tp_min_ms,tp_max_ms,ci_level,"
+        << "compute_median_ms,comm_median_ms,speedup,efficiency\n";
+    for (const BenchResult& r : results) {
+        SampleStats ts = sample_stats(r.ts), tp = sample_stats(r.tp);
+        out << (config.weak ? "weak" : "strong") << "," << r.N << "," << r.P << "," << r.rows << ","
+            << r.cols << "," << config.engine_arg << "," << config.warmup << "," << config.reps << ",";
+        if (r.ts.empty()) {
+            out << ",,,";
+        } else {
+            out << ts.median * 1000 << "," << ts.ci_low * 1000 << "," << ts.ci_high * 1000 << ",";
+        }
+        out << tp.median * 1000 << "," << tp.ci_low * 1000 << "," << tp.ci_high * 1000 << ","
+            << tp.mean * 1000 << "," << tp.stddev * 1000 << "," << tp.min * 1000 << ","
+            << tp.max * 1000 << "," << tp.level << ","
+            << sample_stats(r.compute).median * 1000 << "," << sample_stats(r.comm).median * 1000 << ",";
+        if (r.ts.empty()) {
+            out << ",\n";
+        } else {
+            out << ts.median / tp.median << "," << ts.median / tp.median / r.P << "\n";
+        }
+    }
+}
+
+void write_json_samples(ofstream& out, const char* name, const vector<double>& samples) {
+    out << "\"" << name << "\": [";
+    for (size_t i = 0; i < samples.size(); i++) out << (i ? ", " : "") << samples[i] * 1000;
+    out << "]";
+}
+
+void write_json_stats(ofstream& out, const char* name, const vector<double>& samples) {
+    SampleStats s = sample_stats(samples);
+    out << "\"" << name << "\": {\"median_ms\": " << s.median * 1000 << ", \"ci_low_ms\": " << s.ci_low * 1000
+        << ", \"ci_high_ms\": " << s.ci_high * 1000 << ", \"ci_level\": " << s.level
+        << ", \"mean_ms\": " << s.mean * 1000 << ", \"stddev_ms\": " << s.stddev * 1000
+        << ", \"min_ms\": " << s.min * 1000 << ", \"max_ms\": " << s.max * 1000 << "}";
+}
+
+void write_json(const string& path, const BenchConfig& config, int launched,
+                const vector<BenchResult>& results) {
+    ofstream out(path);
+    out << fixed << setprecision(6);
+    out << "{\n  \"config\": {\"launched_processes\": " << launched
+        << ", \"scaling\": \"" << (config.weak ? "weak" : "strong") << "\""
+        << ", \"min\": " << config.min_arg << ", \"max\": " << config.max_arg
+        << ", \"warmup\": " << config.warmup << ", \"reps\": " << config.reps
+        << ", \"dist\": \"" << distribution_name(config.dist) << "\""
+        << ", \"engine\": \"" << config.engine_arg << "\""
+        << ", \"baseline_engine\": \"" << config.baseline_engine << "\""
+        << ", \"ranking\": \"" << ranking_kernel_name(config.ranking_kernel) << "\""
+        << ", \"sort\": \"" << sort_backend_name(config.sort_backend) << "\""
+        << ", \"threads\": " << config.threads << ", \"sorted\": " << (config.sorted_output ? "true" : "false")
+        << ", \"scatter\": " << (config.scatter ? "true" : "false")
+        << ", \"pipeline\": " << config.pipeline_segments
+        << ", \"compress\": " << (config.compress ? "true" : "false")
+        << ", \"barriers\": " << (config.barriers ? "true" : "false")
+        << ", \"verify\": " << (config.verify ? "true" : "false") << "},\n";
+    out << "  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        out << "    {\"N\": " << r.N << ", \"P\": " << r.P << ", \"rows\": " << r.rows << ", \"cols\": " << r.cols
+            << ",\n     ";
+        if (!r.ts.empty()) {
+            SampleStats ts = sample_stats(r.ts), tp = sample_stats(r.tp);
+            out << "\"speedup\": " << ts.median / tp.median << ", \"efficiency\": "
+                << ts.median / tp.median / r.P << ",\n     ";
+            write_json_stats(out, "ts", r.ts);
+            out << ",\n     ";
+        }
+        write_json_stats(out, "tp", r.tp);
+        out << ",\n     ";
+        write_json_stats(out, "compute", r.compute);
+        out << ",\n     ";
+        write_json_stats(out, "comm", r.comm);
+        out << ",\n     ";
+        write_json_samples(out, "ts_samples_ms", r.ts);
+        out << ",\n     ";
+        write_json_samples(out, "tp_samples_ms", r.tp);
+        out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char** argv) {
+    int thread_support;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &thread_support);
+    
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    
+    BenchConfig config;
+    if (!parse_bench_args(argc, argv, rank, size, config)) {
+        MPI_Finalize();
+        return 1;
+    }
+    
+    if (config.threads > 1 && thread_support < MPI_THREAD_FUNNELED) {
+        if (rank == 0) cerr << "ERROR: la implementación MPI no soporta MPI_THREAD_FUNNELED\n";
+        MPI_Finalize();
+        return 1;
+    }
+    
+    // El baseline es el de sequential.cpp: claves y N en int
+    int min_val = 0, max_val = 0;
+    if (!KeyTraits<int>::parse(config.min_arg.c_str(), min_val) ||
+        !KeyTraits<int>::parse(config.max_arg.c_str(), max_val) || min_val >= max_val) {
+        if (rank == 0) cerr << "ERROR: [min, max] no es un rango int válido\n";
+        MPI_Finalize();
+        return 1;
+    }
+    
+    unique_ptr<ThreadPool> pool_storage;
+    if (config.threads > 1) pool_storage = make_unique<ThreadPool>(config.threads);
+    ThreadPool* pool = pool_storage.get();
+    
+    if (rank == 0) {
+        cout << fixed << setprecision(3);
+        cout << "RANKING BENCH: " << size << " procesos lanzados, " << config.warmup << " calentamiento + "
+             << config.reps << " medidas por configuración (" << (config.weak ? "weak" : "strong")
+             << " scaling)\n\n";
+        cout << "         N     P  malla      Ts med (ms)      Tp med (ms)  IC Tp (ms)              speedup  efic.\n";
+    }
+    
+    vector<BenchResult> results;
+    map<long long, vector<double>> baselines;  // Ts por N (se reusa entre ps)
+    int status = 0;
+    
+    for (long long base_n : config.ns) {
+        for (long long P : config.ps) {
+            long long N = config.weak ? llround(base_n * sqrt((double)P)) : base_n;
+            Grid grid = make_grid(P, N);
+            if (N < P || grid.max_block_size() > INT_MAX) {
+                if (rank == 0) cerr << "AVISO: se omite N = " << N << ", P = " << P << " (bloques inválidos)\n";
+                continue;
+            }
+            
+            BenchResult result = {N, (int)P, grid.rows, grid.cols, {}, {}, {}, {}};
+            
+            // Baseline secuencial en rank 0, mientras el resto espera
+            if (config.baseline && N <= INT_MAX) {
+                if (!baselines.count(N) && rank == 0) {
+                    vector<double>& ts = baselines[N];
+                    for (int k = 0; k < config.warmup; k++) run_sequential(config, N, min_val, max_val);
+                    for (int k = 0; k < config.reps; k++) ts.push_back(run_sequential(config, N, min_val, max_val));
+                }
+                if (rank == 0) result.ts = baselines[N];
+            }
+            MPI_Barrier(MPI_COMM_WORLD);
+            
+            // Paralelo sobre los primeros P procesos
+            MPI_Comm comm;
+            MPI_Comm_split(MPI_COMM_WORLD, rank < P ? 0 : MPI_UNDEFINED, rank, &comm);
+            if (comm != MPI_COMM_NULL) {
+                for (int k = 0; k < config.warmup + config.reps && status == 0; k++) {
+                    Metrics metrics = {};
+                    status = run_parallel(config, grid, rank, comm, pool, metrics);
+                    if (k < config.warmup) continue;
+                    result.tp.push_back(metrics.total_time);
+                    result.compute.push_back(metrics.compute_time);
+                    result.comm.push_back(metrics.comm_time);
+                }
+                MPI_Comm_free(&comm);
+            }
+            MPI_Allreduce(MPI_IN_PLACE, &status, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+            if (status != 0) break;
+            
+            if (rank == 0) {
+                SampleStats tp = sample_stats(result.tp);
+                ostringstream ci;
+                ci << fixed << setprecision(3) << "[" << tp.ci_low * 1000 << ", " << tp.ci_high * 1000 << "]";
+                cout << setw(10) << N << setw(6) << P << "  " << setw(5) << left
+                     << (to_string(grid.rows) + "x" + to_string(grid.cols)) << right;
+                if (result.ts.empty()) {
+                    cout << setw(17) << "-";
+                } else {
+                    cout << setw(17) << sample_stats(result.ts).median * 1000;
+                }
+                cout << setw(17) << tp.median * 1000 << "  " << setw(22) << left << ci.str() << right;
+                if (result.ts.empty()) {
+                    cout << setw(8) << "-" << setw(7) << "-";
+                } else {
+                    double speedup = sample_stats(result.ts).median / tp.median;
+                    cout << setw(8) << speedup << setw(7) << speedup / P;
+                }
+                cout << "\n";
+                results.push_back(result);
+            }
+        }
+        if (status != 0) break;
+    }
+    
+    if (rank == 0 && status == 0) {
+        if (!results.empty()) {
+            cout << "\nIC: mediana, nivel " << sample_stats(results[0].tp).level * 100
+                 << "% (estadísticos de orden)\n";
+        }
+        if (!config.json_path.empty()) {
+            write_json(config.json_path, config, size, results);
+            cout << "JSON: " << config.json_path << "\n";
+        }
+        if (!config.csv_path.empty()) {
+            write_csv(config.csv_path, config, results);
+            cout << "CSV: " << config.csv_path << "\n";
+        }
+    }
+    
+    MPI_Finalize();
+    return status;
+}
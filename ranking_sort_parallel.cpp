@@ -4,335 +4,3614 @@
 #include <algorithm>
 #include <cmath>
 #include <iomanip>
-#include <random>
 #include <cstdlib>
+#include <cstdio>
 #include <string>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <climits>
+#include <cstring>
+#include <functional>
+#include <csignal>
+#include <deque>
+
+#include "key_traits.h"
+#include "search_index.h"
+#include "histogram_ranking.h"
+#include "radix_sort.h"
+#include "thread_pool.h"
+#include "philox.h"
+#include "bit_packing.h"
+#include "trace.h"
+#include "perf_counters.h"
+#include "distributions.h"
+#include "kernel_selection.h"
+#include "batch_source.h"
+#include "order_stat_tree.h"
 
 using namespace std;
 
 // ===== ESTRUCTURAS =====
+// Kernel usado en la fase 4 para contar cuántos elementos de sorted_local son <= v
+enum class RankingKernel {
+    BSEARCH,  // una búsqueda binaria (upper_bound) por elemento
+    MERGE,    // ordena el bloque broadcast con sus índices y hace un único recorrido lineal
+    INDEX,    // índice Eytzinger sobre sorted_local con consultas por lotes
+    AUTO      // cada proceso elige según una muestra de su bloque (choose_kernels)
+};
+
+// Backend del sort local (fase 3)
+enum class SortBackend {
+    STD,    // std::sort
+    RADIX,  // radix sort LSD (serial o multihilo, ver radix_sort.h)
+    AUTO    // cada proceso elige según una muestra de su bloque (choose_kernels)
+};
+
+// Motor de ranking completo
+enum class Engine {
+    SORT,       // fases 2-5: broadcast + sort + ranking por comparación + reduce
+    HISTOGRAM   // histograma del rango [min, max] + suma prefija (sin fases 2 y 4)
+};
+
 struct Metrics {
     double total_time;
     double phase1_time;
+    double input_bytes;   // bytes leídos del archivo por todos los procesos (--input)
     double phase2_time;
+    double phase2_bytes;       // bytes del broadcast sin comprimir (todas las filas)
+    double phase2_wire_bytes;  // bytes del broadcast en la red (--compress: empaquetados)
     double phase3_time;
+    double index_time;    // construcción del índice de búsqueda (solo kernel index)
     double phase4_time;
+    double pipeline_time;     // tiempo de pared de las fases 2-5 solapadas (--pipeline)
+    double pipeline_inflight; // tiempo con broadcasts/reduces en vuelo (--pipeline)
+    double phase3_util;   // utilización de hilos en fase 3 (modo híbrido)
+    double phase4_util;   // utilización de hilos en fase 4 (modo híbrido)
     double phase5_time;
+    double phase5_bytes;       // bytes de los rankings parciales sin comprimir (todos los procesos)
+    double phase5_wire_bytes;  // bytes de los rankings parciales en la red
+    double phase6_time;   // redistribución al orden global (--sorted)
+    double phase6_bytes;  // bytes enviados a otros procesos en la fase 6 (todos los procesos)
+    double output_time;   // escritura del arreglo ordenado (--output)
     double compute_time;  // sort + ranking
     double comm_time;     // broadcast + reduce
 };
 
-// ===== FUNCIONES AUXILIARES =====
-pair<int, int> rank_to_position(int rank, int p) {
-    return {rank / p, rank % p};
+// Metrics solo tiene double: viaja como arreglo de METRIC_FIELDS doubles
+const int METRIC_FIELDS = sizeof(Metrics) / sizeof(double);
+
+// ===== MALLA DE PROCESOS =====
+// P = rows × cols procesos; el proceso rank está en (rank / cols, rank % cols).
+// Los N elementos se parten en P grupos contiguos de N/P (redondeado: los
+// tamaños difieren a lo sumo en 1). La columna j guarda los grupos g ≡ j
+// (mod cols) y la fila i rankea los grupos g ≡ i (mod rows), que reparte su
+// raíz (i, i mod cols). En malla cuadrada la raíz es la diagonal y el bloque
+// de la fila coincide con su bloque de columna.
+struct Grid {
+    int rows;
+    int cols;
+    long long N;
+    
+    int size() const { return rows * cols; }
+    bool square() const { return rows == cols; }
+    int row_root(int row) const { return row % cols; }
+    
+    // Inicio del grupo g (también del tramo de salida del proceso g en la fase 6)
+    long long group_begin(int g) const { return (long long)N * g / size(); }
+    int group_size(int g) const { return group_begin(g + 1) - group_begin(g); }
+    
+    // Grupo (o tramo de salida) que contiene la posición global pos
+    int group_of(long long pos) const { return ((pos + 1) * size() - 1) / N; }
+    
+    // Elementos de los grupos first, first + step, ... (< P)
+    long long groups_size(int first, int step) const {
+        long long total = 0;
+        for (int g = first; g < size(); g += step) total += group_size(g);
+        return total;
+    }
+    long long column_block_size(int col) const { return groups_size(col, cols); }
+    long long row_block_size(int row) const { return groups_size(row, rows); }
+    
+    // Bloque más grande que guarda un proceso (de columna o de fila): los
+    // índices, conteos locales y cuentas MPI por proceso son int
+    long long max_block_size() const {
+        long long largest = 0;
+        for (int c = 0; c < cols; c++) largest = max(largest, column_block_size(c));
+        for (int r = 0; r < rows; r++) largest = max(largest, row_block_size(r));
+        return largest;
+    }
+    
+    // Posición del grupo g dentro del bloque de su columna
+    int column_offset(int g) const {
+        int offset = 0;
+        for (int h = g % cols; h < g; h += cols) offset += group_size(h);
+        return offset;
+    }
+    
+    // ¿Algún grupo pertenece a la vez al bloque de la fila row y al de la columna col?
+    bool intersects(int row, int col) const {
+        for (int g = col; g < size(); g += cols) {
+            if (g % rows == row) return true;
+        }
+        return false;
+    }
+};
+
+// Malla lo más cuadrada posible: cols = mayor divisor de P que no supera √P
+Grid make_grid(int P, long long N) {
+    int cols = static_cast<int>(sqrt(P));
+    while (P % cols != 0) cols--;
+    return {P / cols, cols, N};
 }
 
-bool is_diagonal(int rank, int p) {
-    auto [row, col] = rank_to_position(rank, p);
-    return row == col;
+pair<int, int> rank_to_position(int rank, const Grid& grid) {
+    return {rank / grid.cols, rank % grid.cols};
 }
 
-vector<int> generate_random_array(int N, int min_val, int max_val, int seed = 42) {
-    vector<int> data;
-    data.reserve(N);
-    
-    mt19937 rng(seed);
-    uniform_int_distribution<int> dist(min_val, max_val);
+// La raíz de la fila reparte su bloque (fase 2) y recibe el ranking (fase 5)
+bool is_row_root(int rank, const Grid& grid) {
+    auto [row, col] = rank_to_position(rank, grid);
+    return col == grid.row_root(row);
+}
+
+// Tramo [begin, end) de la parte c de un bloque de n elementos partido en parts
+inline int block_part_begin(int n, int c, int parts) {
+    return static_cast<int>((long long)n * c / parts);
+}
+
+// ===== TIPO DEL RANKING =====
+// Los rankings globales (y los destinos de la fase 6) llegan hasta N: con
+// N <= INT_MAX se usan int (mitad de memoria y de bytes en el reduce), si no
+// int64_t. Los conteos locales siempre caben en int (bloques < 2^31).
+template <typename Rank>
+MPI_Datatype rank_mpi_type() {
+    return sizeof(Rank) == sizeof(int64_t) ? MPI_INT64_T : MPI_INT;
+}
+
+// Buffer de envío del reduce en el tipo Rank: con int son los mismos conteos,
+// con int64_t se ensanchan en storage
+template <typename Rank>
+const Rank* widen_ranking(const int* local_ranking, size_t n, vector<Rank>& storage) {
+    if constexpr (is_same_v<Rank, int>) {
+        return local_ranking;
+    } else {
+        storage.assign(local_ranking, local_ranking + n);
+        return storage.data();
+    }
+}
+
+// ===== TIPO DE LAS CLAVES =====
+// Todo el motor es una plantilla sobre Key (char, int, int64_t, float, double):
+// orden y transformación de radix en KeyTraits (key_traits.h), tipo MPI acá.
+// Las claves angostas mueven menos datos en el broadcast, la lectura y la fase 6.
+template <typename Key>
+MPI_Datatype key_mpi_type() {
+    if constexpr (is_same_v<Key, char>) return MPI_CHAR;
+    else if constexpr (is_same_v<Key, int>) return MPI_INT;
+    else if constexpr (is_same_v<Key, int64_t>) return MPI_INT64_T;
+    else if constexpr (is_same_v<Key, float>) return MPI_FLOAT;
+    else return MPI_DOUBLE;
+}
+
+// ===== FASE 1: INPUT + GOSSIP (DISTRIBUCIÓN LOCAL) =====
+// Cada proceso genera directamente solo sus grupos con el generador por
+// contador (philox.h, distributions.h): el elemento global i vale lo mismo en
+// cualquier proceso, así que el resultado es idéntico a seleccionar esos
+// grupos del arreglo completo, sin materializar los N elementos en cada proceso.
+
+// Concatena los grupos first, first + step, ... generados en orden
+template <typename Key>
+vector<Key> generate_groups(const Grid& grid, int first, int step,
+                            Key min_val, Key max_val, uint64_t seed, Distribution dist) {
+    vector<Key> data(grid.groups_size(first, step));
+    size_t offset = 0;
+    for (int g = first; g < grid.size(); g += step) {
+        distribution_fill(data.data() + offset, grid.group_begin(g), grid.group_size(g), (uint64_t)grid.N,
+                          min_val, max_val, seed, dist);
+        offset += grid.group_size(g);
+    }
+    return data;
+}
+
+// Bloque de la columna: grupos g ≡ col (mod cols)
+template <typename Key>
+vector<Key> phase1_input_gossip(
+    const Grid& grid, Key min_val, Key max_val,
+    int rank,
+    Distribution dist = Distribution::UNIFORM,
+    uint64_t seed = 42
+) {
+    auto [row, col] = rank_to_position(rank, grid);
+    return generate_groups(grid, col, grid.cols, min_val, max_val, seed, dist);
+}
+
+// Bloque de la fila (grupos g ≡ row mod rows): en malla rectangular la raíz lo
+// genera aparte; en la cuadrada es su propio bloque y se devuelve vacío
+template <typename Key>
+vector<Key> phase1_row_block(
+    const Grid& grid, Key min_val, Key max_val,
+    int rank,
+    Distribution dist = Distribution::UNIFORM,
+    uint64_t seed = 42
+) {
+    auto [row, col] = rank_to_position(rank, grid);
+    if (grid.square() || !is_row_root(rank, grid)) return {};
+    return generate_groups(grid, row, grid.rows, min_val, max_val, seed, dist);
+}
+
+// ===== FASE 1 (ARCHIVO): LECTURA PARALELA CON MPI-IO =====
+// Archivo binario de claves nativas del tipo Key (int32 por defecto, ver
+// --key); se usan las primeras N. Cada proceso lee
+// solo sus grupos con una vista indexada (un bloque por grupo, de tamaños
+// posiblemente distintos). Las lecturas son colectivas (MPI_File_read_at_all)
+// para que MPI-IO agregue los accesos de la columna.
+
+// Lee los grupos first, first + step, ...; con participate = false el proceso
+// entra a la colectiva sin leer nada
+template <typename Key>
+bool read_groups(MPI_File fh, const Grid& grid, int first, int step,
+                 bool participate, vector<Key>& out) {
+    // Desplazamientos en bytes (MPI_Aint): con N > 2^31 no caben en int
+    vector<int> lengths;
+    vector<MPI_Aint> displacements;
+    for (int g = first; participate && g < grid.size(); g += step) {
+        lengths.push_back(grid.group_size(g));
+        displacements.push_back((MPI_Aint)grid.group_begin(g) * sizeof(Key));
+    }
     
-    for (int i = 0; i < N; i++) {
-        data.push_back(dist(rng));
+    MPI_Datatype key_type = key_mpi_type<Key>();
+    MPI_Datatype filetype = key_type;
+    if (!lengths.empty()) {
+        MPI_Type_create_hindexed(lengths.size(), lengths.data(), displacements.data(), key_type, &filetype);
+        MPI_Type_commit(&filetype);
     }
+    MPI_File_set_view(fh, 0, key_type, filetype, "native", MPI_INFO_NULL);
     
-    return data;
+    out.resize(participate ? grid.groups_size(first, step) : 0);
+    TraceScope scope("MPI_File_read_at_all", "io");
+    int status = MPI_File_read_at_all(fh, 0, out.data(), out.size(), key_type, MPI_STATUS_IGNORE);
+    
+    if (!lengths.empty()) MPI_Type_free(&filetype);
+    return status == MPI_SUCCESS;
 }
 
-// ===== FASE 1: INPUT + GOSSIP (DISTRIBUCIÓN LOCAL) =====
-// Cada proceso genera los datos completos y selecciona lo que necesita
-vector<int> phase1_input_gossip(
-    const vector<int>& global_data,
-    int rank, int size, int p
+// local_data recibe el bloque de la columna; row_block, en malla rectangular y
+// si with_row_block, el bloque de la fila en su raíz (igual que phase1_row_block)
+template <typename Key>
+bool phase1_input_file(
+    const string& path, const Grid& grid,
+    int rank, bool with_row_block,
+    vector<Key>& local_data,
+    vector<Key>& row_block,
+    MPI_Comm comm
 ) {
-    int N = global_data.size();
-    int P = size;
-    int elements_per_group = N / P;        // N/P
-    int elements_per_process = elements_per_group * p;  // N/p
+    auto [row, col] = rank_to_position(rank, grid);
+    long long N = grid.N;
     
-    vector<int> local_data;
-    local_data.reserve(elements_per_process);
+    MPI_File fh;
+    if (MPI_File_open(comm, path.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        if (rank == 0) cerr << "ERROR: no se pudo abrir " << path << "\n";
+        return false;
+    }
     
-    int rank_mod_p = rank % p;
+    MPI_Offset file_size;
+    MPI_File_get_size(fh, &file_size);
+    if (file_size < (MPI_Offset)N * (MPI_Offset)sizeof(Key)) {
+        if (rank == 0) {
+            cerr << "ERROR: " << path << " tiene " << file_size / sizeof(Key)
+                 << " claves " << KeyTraits<Key>::name << ", se necesitan N = " << N << "\n";
+        }
+        MPI_File_close(&fh);
+        return false;
+    }
     
-    // Seleccionar grupos según rank_mod_p
-    for (int group_id = 0; group_id < P; group_id++) {
-        if (group_id % p == rank_mod_p) {
-            int start_idx = group_id * elements_per_group;
-            for (int i = 0; i < elements_per_group; i++) {
-                local_data.push_back(global_data[start_idx + i]);
-            }
+    bool ok = read_groups(fh, grid, col, grid.cols, true, local_data);
+    if (with_row_block && !grid.square()) {
+        ok = read_groups(fh, grid, row, grid.rows, is_row_root(rank, grid), row_block) && ok;
+    }
+    
+    MPI_File_close(&fh);
+    
+    if (!ok) {
+        if (rank == 0) cerr << "ERROR: falló la lectura de " << path << "\n";
+        return false;
+    }
+    return true;
+}
+
+// ===== FASE 1 (SERVICIO): REPARTO DE UN LOTE =====
+// Con --serve el lote completo llega a rank 0 = (0, 0). Los bloques de columna
+// se reparten en la fila 0 (MPI_Scatterv en su comunicador de fila) y cada uno
+// baja por su columna (MPI_Bcast en col_comm); en malla rectangular los
+// bloques de fila van directo a sus raíces. Los buffers y col_comm viven en
+// ServiceBuffers y se reusan entre lotes.
+template <typename Key>
+struct ServiceBuffers {
+    vector<Key> keys;            // lote recibido (rank 0)
+    vector<Key> packed;          // lote en orden de bloques (rank 0)
+    vector<Key> column_block, row_block;
+    vector<int64_t> ranking;     // rankings propios del lote (dueños)
+    vector<int64_t> gathered;    // rankings de todos los dueños (rank 0)
+    vector<int64_t> response;    // rankings en el orden del pedido (rank 0)
+    Engine engine;               // motor y reparto del último lote (ver owned_ranking_segments)
+    bool scattered;
+    MPI_Comm col_comm;
+};
+
+// Copia a packed los grupos de cada destino (groups(d) = primer grupo y paso)
+// y deja counts/displs para MPI_Scatterv
+template <typename Key, typename Groups>
+void pack_groups(const vector<Key>& keys, const Grid& grid, int destinations, Groups groups,
+                 vector<Key>& packed, vector<int>& counts, vector<int>& displs) {
+    packed.resize(keys.size());
+    counts.assign(destinations, 0);
+    displs.assign(destinations, 0);
+    size_t offset = 0;
+    for (int d = 0; d < destinations; d++) {
+        auto [first, step] = groups(d);
+        displs[d] = offset;
+        for (int g = first; first >= 0 && g < grid.size(); g += step) {
+            copy_n(keys.begin() + grid.group_begin(g), grid.group_size(g), packed.begin() + offset);
+            offset += grid.group_size(g);
         }
+        counts[d] = offset - displs[d];
+    }
+}
+
+// Mismo resultado que phase1_input_gossip/phase1_row_block con el lote como arreglo global
+template <typename Key>
+void phase1_input_batch(
+    ServiceBuffers<Key>& buffers, const Grid& grid,
+    int rank, bool with_row_block,
+    vector<Key>& local_data,
+    vector<Key>& row_block,
+    MPI_Comm row_comm, MPI_Comm comm
+) {
+    auto [row, col] = rank_to_position(rank, grid);
+    MPI_Datatype key_type = key_mpi_type<Key>();
+    vector<int> counts, displs;
+    
+    local_data = move(buffers.column_block);
+    local_data.resize(grid.column_block_size(col));
+    if (row == 0) {
+        if (rank == 0) {
+            pack_groups(buffers.keys, grid, grid.cols, [&](int c) { return make_pair(c, grid.cols); },
+                        buffers.packed, counts, displs);
+        }
+        TraceScope scope("MPI_Scatterv (lote)", "colectiva");
+        MPI_Scatterv(buffers.packed.data(), counts.data(), displs.data(), key_type,
+                     local_data.data(), local_data.size(), key_type, 0, row_comm);
+    }
+    {
+        TraceScope scope("MPI_Bcast (columna)", "colectiva");
+        MPI_Bcast(local_data.data(), local_data.size(), key_type, 0, buffers.col_comm);
     }
     
-    return local_data;
+    row_block = move(buffers.row_block);
+    row_block.clear();
+    if (with_row_block && !grid.square()) {
+        if (rank == 0) {
+            pack_groups(buffers.keys, grid, grid.size(), [&](int r) {
+                return is_row_root(r, grid) ? make_pair(r / grid.cols, grid.rows) : make_pair(-1, 0);
+            }, buffers.packed, counts, displs);
+        }
+        if (is_row_root(rank, grid)) row_block.resize(grid.row_block_size(row));
+        TraceScope scope("MPI_Scatterv (fila)", "colectiva");
+        MPI_Scatterv(buffers.packed.data(), counts.data(), displs.data(), key_type,
+                     row_block.data(), row_block.size(), key_type, 0, comm);
+    }
 }
 
 // ===== FASE 2: BROADCAST HORIZONTAL =====
-vector<int> phase2_broadcast(
-    const vector<int>& local_data,
-    int rank, int p,
+// El tamaño del bloque de cada fila se deduce de la malla, así que todos los
+// procesos de la fila lo conocen sin comunicarlo
+template <typename Key>
+vector<Key> phase2_broadcast(
+    const vector<Key>& local_data,
+    const vector<Key>& row_block,
+    int rank, const Grid& grid,
     MPI_Comm row_comm
 ) {
-    auto [row, col] = rank_to_position(rank, p);
+    auto [row, col] = rank_to_position(rank, grid);
     
-    vector<int> broadcasted_data(local_data.size());
+    vector<Key> broadcasted_data(grid.row_block_size(row));
     
-    // Procesos diagonales copian sus datos
-    if (is_diagonal(rank, p)) {
-        broadcasted_data = local_data;
+    // La raíz copia el bloque de la fila (en malla cuadrada, sus propios datos)
+    if (is_row_root(rank, grid)) {
+        broadcasted_data = row_block.empty() ? local_data : row_block;
     }
     
     // Broadcast dentro de cada fila
-    MPI_Bcast(broadcasted_data.data(), broadcasted_data.size(), MPI_INT, row, row_comm);
+    TraceScope scope("MPI_Bcast", "colectiva");
+    MPI_Bcast(broadcasted_data.data(), broadcasted_data.size(), key_mpi_type<Key>(), grid.row_root(row),
+              row_comm);
+    
+    return broadcasted_data;
+}
+
+// ===== FASE 2 (COMPRIMIDA): FRAME-OF-REFERENCE + BIT-PACKING =====
+// La raíz resta a cada clave el mínimo del bloque (en la biyección
+// KeyTraits::bits, que también cubre flotantes sin pérdida) y manda las
+// diferencias en width bits, el ancho del rango real del bloque. Antes viaja
+// el encabezado (mínimo, width) para que la fila sepa cuántas palabras llegan.
+// bytes recibe {sin comprimir, en la red}; solo la raíz los cuenta (una vez por fila).
+template <typename Key>
+vector<Key> phase2_broadcast_packed(
+    const vector<Key>& local_data,
+    const vector<Key>& row_block,
+    int rank, const Grid& grid,
+    MPI_Comm row_comm,
+    double* bytes
+) {
+    using Traits = KeyTraits<Key>;
+    auto [row, col] = rank_to_position(rank, grid);
+    bool is_root = is_row_root(rank, grid);
+    size_t n = grid.row_block_size(row);
+    const vector<Key>& block = row_block.empty() ? local_data : row_block;
+    
+    uint64_t header[2] = {0, 0};  // {mínimo, width}
+    if (is_root) {
+        uint64_t lo = ~uint64_t(0), hi = 0;
+        for (Key value : block) {
+            uint64_t code = Traits::bits(value);
+            lo = min(lo, code);
+            hi = max(hi, code);
+        }
+        header[0] = lo;
+        header[1] = bit_width(hi - lo);
+    }
+    {
+        TraceScope scope("MPI_Bcast (encabezado)", "colectiva");
+        MPI_Bcast(header, 2, MPI_UINT64_T, grid.row_root(row), row_comm);
+    }
+    uint64_t base = header[0];
+    int width = static_cast<int>(header[1]);
+    
+    vector<uint64_t> packed(packed_words(n, width), 0);
+    if (is_root) {
+        pack_bits(n, width, [&](size_t i) { return Traits::bits(block[i]) - base; }, packed.data());
+    }
+    {
+        TraceScope scope("MPI_Bcast (empaquetado)", "colectiva");
+        MPI_Bcast(packed.data(), packed.size(), MPI_UINT64_T, grid.row_root(row), row_comm);
+    }
+    
+    // La raíz ya tiene el bloque; el resto lo decodifica
+    vector<Key> broadcasted_data(n);
+    if (is_root) {
+        broadcasted_data = block;
+        bytes[0] = (double)n * sizeof(Key);
+        bytes[1] = sizeof(header) + (double)packed.size() * sizeof(uint64_t);
+    } else {
+        unpack_bits(packed.data(), n, width, [&](size_t i, uint64_t delta) {
+            broadcasted_data[i] = Traits::from_bits(static_cast<typename Traits::Ordered>(base + delta));
+        });
+    }
     
     return broadcasted_data;
 }
 
 // ===== FASE 3: SORT LOCAL =====
-void phase3_sort(vector<int>& local_data) {
-    sort(local_data.begin(), local_data.end());
+// Con pool (modo híbrido) el radix reparte cada pasada en tareas del pool y
+// std::sort se convierte en sort por bloques + merge paralelo.
+template <typename Key>
+void phase3_sort(vector<Key>& local_data, SortBackend backend = SortBackend::STD,
+                 ThreadPool* pool = nullptr) {
+    if (backend == SortBackend::RADIX) {
+        if (pool) {
+            radix_sort_with(local_data, pool->size(), [pool](int count, auto fn) {
+                pool->parallel_for(0, count, 1, [&fn](size_t lo, size_t hi) {
+                    for (size_t t = lo; t < hi; t++) fn(static_cast<int>(t));
+                });
+            });
+        } else {
+            radix_sort(local_data);
+        }
+    } else if (pool) {
+        parallel_sort(*pool, local_data, [](auto first, auto last) { sort(first, last); });
+    } else {
+        sort(local_data.begin(), local_data.end());
+    }
+}
+
+const char* sort_backend_name(SortBackend backend) {
+    switch (backend) {
+        case SortBackend::RADIX: return "radix";
+        case SortBackend::AUTO:  return "auto";
+        default:                 return "std";
+    }
 }
 
 // ===== FASE 4: LOCAL RANKING =====
+// Con pool, el bloque broadcast se reparte en tramos de RANKING_GRAIN consultas
+const size_t RANKING_GRAIN = 16384;
+
+template <typename Key>
 vector<int> phase4_local_ranking(
-    const vector<int>& sorted_local, 
-    const vector<int>& broadcasted
+    const vector<Key>& sorted_local, 
+    const vector<Key>& broadcasted,
+    ThreadPool* pool = nullptr
+) {
+    vector<int> ranking(broadcasted.size());
+    
+    auto rank_range = [&](size_t lo, size_t hi) {
+        for (size_t i = lo; i < hi; i++) {
+            ranking[i] = upper_bound(sorted_local.begin(), sorted_local.end(), broadcasted[i]) 
+                         - sorted_local.begin();
+        }
+    };
+    
+    if (pool) {
+        pool->parallel_for(0, broadcasted.size(), RANKING_GRAIN, rank_range);
+    } else {
+        rank_range(0, broadcasted.size());
+    }
+    
+    return ranking;
+}
+
+// Empaqueta (valor, índice) en una clave que se ordena con una sola comparación.
+// El valor va transformado con KeyTraits::ordered (preserva el orden de
+// negativos y flotantes); a igual valor queda primero el índice menor (orden
+// estable). Claves de hasta 32 bits entran en un uint64; las de 64 bits van
+// en un par (valor, índice).
+template <typename Key>
+using KeyedEntry = conditional_t<sizeof(Key) <= sizeof(uint32_t), uint64_t, pair<uint64_t, uint32_t>>;
+
+template <typename Key>
+inline KeyedEntry<Key> keyed_entry(Key value, int index) {
+    uint64_t key = KeyTraits<Key>::ordered(value);
+    if constexpr (sizeof(Key) <= sizeof(uint32_t)) {
+        return (key << 32) | static_cast<uint32_t>(index);
+    } else {
+        return {key, static_cast<uint32_t>(index)};
+    }
+}
+
+template <typename Key>
+vector<KeyedEntry<Key>> sort_with_indices(const vector<Key>& values, ThreadPool* pool = nullptr) {
+    int n = values.size();
+    vector<KeyedEntry<Key>> keyed(n);
+    for (int i = 0; i < n; i++) {
+        keyed[i] = keyed_entry(values[i], i);
+    }
+    if (pool) {
+        parallel_sort(*pool, keyed, [](auto first, auto last) { sort(first, last); });
+    } else {
+        sort(keyed.begin(), keyed.end());
+    }
+    return keyed;
+}
+
+template <typename Key>
+inline Key keyed_value(const KeyedEntry<Key>& entry) {
+    using Ordered = typename KeyTraits<Key>::Ordered;
+    if constexpr (sizeof(Key) <= sizeof(uint32_t)) {
+        return KeyTraits<Key>::from_ordered(static_cast<Ordered>(entry >> 32));
+    } else {
+        return KeyTraits<Key>::from_ordered(entry.first);
+    }
+}
+
+inline int keyed_index(uint64_t entry) {
+    return static_cast<int>(entry & 0xFFFFFFFFu);
+}
+
+inline int keyed_index(const pair<uint64_t, uint32_t>& entry) {
+    return static_cast<int>(entry.second);
+}
+
+// Variante merge: en lugar de N/p búsquedas aleatorias sobre sorted_local,
+// ordena el bloque broadcast junto con su índice original y recorre ambos
+// arreglos una sola vez, escribiendo el conteo en la posición original.
+// Con pool, cada tramo de keyed arranca su recorrido con un upper_bound.
+template <typename Key>
+vector<int> phase4_local_ranking_merge(
+    const vector<Key>& sorted_local,
+    const vector<Key>& broadcasted,
+    ThreadPool* pool = nullptr
+) {
+    int n = broadcasted.size();
+    vector<KeyedEntry<Key>> keyed = sort_with_indices(broadcasted, pool);
+    vector<int> ranking(n);
+    
+    auto walk_range = [&](size_t lo, size_t hi) {
+        if (lo >= hi) return;
+        Key first = keyed_value<Key>(keyed[lo]);
+        size_t j = upper_bound(sorted_local.begin(), sorted_local.end(), first) - sorted_local.begin();
+        size_t m = sorted_local.size();
+        
+        for (size_t k = lo; k < hi; k++) {
+            Key value = keyed_value<Key>(keyed[k]);
+            int idx = keyed_index(keyed[k]);
+            while (j < m && sorted_local[j] <= value) j++;
+            ranking[idx] = j;
+        }
+    };
+    
+    if (pool) {
+        pool->parallel_for(0, n, RANKING_GRAIN, walk_range);
+    } else {
+        walk_range(0, n);
+    }
+    
+    return ranking;
+}
+
+// Variante índice: las consultas se resuelven sobre un índice Eytzinger
+// construido a partir de sorted_local (ver search_index.h)
+template <typename Key>
+vector<int> phase4_local_ranking_index(
+    const EytzingerIndex<Key>& index,
+    const vector<Key>& broadcasted,
+    ThreadPool* pool = nullptr
+) {
+    vector<int> ranking(broadcasted.size());
+    
+    auto rank_range = [&](size_t lo, size_t hi) {
+        index.count_le_batch(broadcasted.data() + lo, hi - lo, ranking.data() + lo);
+    };
+    
+    if (pool) {
+        pool->parallel_for(0, broadcasted.size(), RANKING_GRAIN, rank_range);
+    } else {
+        rank_range(0, broadcasted.size());
+    }
+    
+    return ranking;
+}
+
+// Ranking con el kernel elegido (index requiere el índice ya construido)
+template <typename Key>
+vector<int> phase4_rank(
+    RankingKernel kernel,
+    const vector<Key>& sorted_local,
+    const EytzingerIndex<Key>& index,
+    const vector<Key>& broadcasted,
+    ThreadPool* pool = nullptr
+) {
+    switch (kernel) {
+        case RankingKernel::MERGE: return phase4_local_ranking_merge(sorted_local, broadcasted, pool);
+        case RankingKernel::INDEX: return phase4_local_ranking_index(index, broadcasted, pool);
+        default:                   return phase4_local_ranking(sorted_local, broadcasted, pool);
+    }
+}
+
+// ===== FASE 4 CON DESEMPATE (PARA LA FASE 6) =====
+// Para ubicar cada elemento en una posición única del arreglo ordenado, el
+// ranking usa el orden (valor, bloque de columna, posición dentro del bloque).
+// Para un elemento del bloque de columna b (el de su grupo, g mod cols), la
+// columna col aporta:
+//   col < b: elementos <= v   (igual que el ranking normal)
+//   col > b: elementos <  v   (los iguales de bloques posteriores van después)
+//   col = b: elementos que lo preceden en (valor, posición) dentro del bloque
+// La suma de phase5_reduce es entonces un destino 0..N-1 sin repetidos.
+// own_keys es el bloque de columna original pasado por sort_with_indices (solo
+// se usa si la fila y la columna comparten grupos); block_offset es la posición
+// de broadcasted[0] dentro del bloque de la fila (segmentos del modo pipeline).
+template <typename Key>
+vector<int> phase4_local_ranking_tiebreak(
+    RankingKernel kernel,
+    const vector<Key>& sorted_local,
+    const EytzingerIndex<Key>& index,
+    const vector<KeyedEntry<Key>>& own_keys,
+    const vector<Key>& broadcasted,
+    int rank, const Grid& grid,
+    ThreadPool* pool = nullptr,
+    int block_offset = 0
 ) {
-    vector<int> ranking;
-    ranking.reserve(broadcasted.size());
+    auto [row, col] = rank_to_position(rank, grid);
+    int n = broadcasted.size();
+    
+    if (grid.square() && col == row) {
+        // En la diagonal el broadcast es el propio bloque en orden original
+        vector<int> ranking(n);
+        for (int k = 0; k < n; k++) {
+            ranking[keyed_index(own_keys[k])] = k;
+        }
+        return ranking;
+    }
     
-    for (int value : broadcasted) {
-        int count = upper_bound(sorted_local.begin(), sorted_local.end(), value) 
-                    - sorted_local.begin();
-        ranking.push_back(count);
+    // count(< v) == count(<= anterior a v); el mínimo del tipo no tiene anterior
+    using Traits = KeyTraits<Key>;
+    vector<Key> queries(n);
+    int group_start = 0;
+    for (int g = row; g < grid.size(); g += grid.rows) {
+        int lo = max(group_start, block_offset) - block_offset;
+        int hi = min(group_start + grid.group_size(g), block_offset + n) - block_offset;
+        bool strict = col > g % grid.cols;
+        for (int i = lo; i < hi; i++) {
+            Key v = broadcasted[i];
+            queries[i] = (strict && Traits::has_predecessor(v)) ? Traits::predecessor(v) : v;
+        }
+        group_start += grid.group_size(g);
+    }
+    
+    vector<int> ranking = phase4_rank(kernel, sorted_local, index, queries, pool);
+    
+    group_start = 0;
+    for (int g = row; g < grid.size(); g += grid.rows) {
+        int lo = max(group_start, block_offset) - block_offset;
+        int hi = min(group_start + grid.group_size(g), block_offset + n) - block_offset;
+        int b = g % grid.cols;
+        if (col > b) {
+            for (int i = lo; i < hi; i++) {
+                if (!Traits::has_predecessor(broadcasted[i])) ranking[i] = 0;
+            }
+        } else if (col == b) {
+            // Grupo del propio bloque: posición estable en (valor, posición)
+            int position = grid.column_offset(g) + (lo + block_offset - group_start);
+            for (int i = lo; i < hi; i++, position++) {
+                ranking[i] = lower_bound(own_keys.begin(), own_keys.end(),
+                                         keyed_entry(broadcasted[i], position)) - own_keys.begin();
+            }
+        }
+        group_start += grid.group_size(g);
+    }
+    return ranking;
+}
+
+// Claves (valor, posición) del bloque de columna original que necesita el
+// desempate; vacío si la fila y la columna no comparten grupos
+template <typename Key>
+vector<KeyedEntry<Key>> tiebreak_own_keys(const vector<Key>& original_local, int rank, const Grid& grid,
+                                          ThreadPool* pool = nullptr) {
+    auto [row, col] = rank_to_position(rank, grid);
+    if (!grid.intersects(row, col)) return {};
+    return sort_with_indices(original_local, pool);
+}
+
+const char* ranking_kernel_name(RankingKernel kernel) {
+    switch (kernel) {
+        case RankingKernel::MERGE: return "merge";
+        case RankingKernel::INDEX: return "index";
+        case RankingKernel::AUTO:  return "auto";
+        default:                   return "bsearch";
+    }
+}
+
+// ===== SELECCIÓN ADAPTATIVA DE KERNELS =====
+// Reglas y muestreo en kernel_selection.h. Se muestrea el bloque de columna,
+// pero el ranking consulta el bloque de la fila: ambos salen de la misma
+// distribución global, así que tienen la misma forma salvo en los bordes.
+struct KernelChoice {
+    DataShape shape;
+    SortBackend sort;
+    RankingKernel ranking;
+};
+
+// Resuelve los AUTO de sort y ranking con la forma de local_data (antes del sort)
+template <typename Key>
+KernelChoice choose_kernels(const vector<Key>& local_data, SortBackend sort, RankingKernel ranking) {
+    KernelChoice choice = {sample_shape(local_data.data(), local_data.size()), sort, ranking};
+    if (sort == SortBackend::AUTO) {
+        choice.sort = prefer_radix(choice.shape, local_data.size()) ? SortBackend::RADIX : SortBackend::STD;
+    }
+    if (ranking == RankingKernel::AUTO) {
+        choice.ranking = prefer_merge(choice.shape) ? RankingKernel::MERGE : RankingKernel::INDEX;
+    }
+    return choice;
+}
+
+// Elección de cada proceso, en rank 0 (vacío en los demás)
+vector<KernelChoice> gather_kernel_choices(const KernelChoice& choice, int rank, int size, MPI_Comm comm) {
+    vector<KernelChoice> choices(rank == 0 ? size : 0);
+    TraceScope scope("MPI_Gather (kernels)", "métricas");
+    MPI_Gather(&choice, sizeof(KernelChoice), MPI_BYTE, choices.data(), sizeof(KernelChoice), MPI_BYTE,
+               0, comm);
+    return choices;
+}
+
+// "radix ×3, std ×1": cuántos procesos eligieron cada nombre, en orden de aparición
+string choice_summary(const vector<const char*>& names) {
+    vector<pair<string, int>> counts;
+    for (const char* name : names) {
+        auto it = find_if(counts.begin(), counts.end(), [name](const auto& c) { return c.first == name; });
+        if (it == counts.end()) {
+            counts.push_back({name, 1});
+        } else {
+            it->second++;
+        }
+    }
+    string summary;
+    for (const auto& [name, count] : counts) {
+        if (!summary.empty()) summary += ", ";
+        summary += name + " ×" + to_string(count);
+    }
+    return summary;
+}
+
+// ===== MOTOR HISTOGRAMA (RANGO ACOTADO) =====
+// Cada fila contiene exactamente una vez cada bloque de columna, así que la suma
+// de los histogramas locales dentro de row_comm es el histograma global.
+// Sin broadcast, el ranking de cada elemento lo calcula el proceso (i, j) de su
+// grupo g (i = g mod rows, j = g mod cols); en malla cuadrada, la diagonal.
+
+// Recorre los grupos del bloque de columna: fn(inicio en local_data, tamaño, propio)
+// donde propio indica que el grupo pertenece también al bloque de la fila
+template <typename Fn>
+void for_each_column_group(int rank, const Grid& grid, Fn fn) {
+    auto [row, col] = rank_to_position(rank, grid);
+    int start = 0;
+    for (int g = col; g < grid.size(); g += grid.cols) {
+        fn(start, grid.group_size(g), g % grid.rows == row);
+        start += grid.group_size(g);
     }
+}
+
+// Valores de los grupos propios, en el orden de phase4_histogram_*
+template <typename Key>
+vector<Key> owned_group_values(const vector<Key>& local_data, int rank, const Grid& grid) {
+    vector<Key> values;
+    for_each_column_group(rank, grid, [&](int start, int count, bool owned) {
+        if (owned) values.insert(values.end(), local_data.begin() + start, local_data.begin() + start + count);
+    });
+    return values;
+}
+
+// Fase 3 (histograma): conteo local de valores en [min, max]. Los conteos
+// usan el tipo del ranking: sumados en la fila llegan hasta N. Solo claves enteras.
+template <typename Rank, typename Key>
+vector<Rank> phase3_histogram(const vector<Key>& local_data, Key min_val, Key max_val) {
+    vector<Rank> hist((size_t)((int64_t)max_val - (int64_t)min_val + 1), 0);
+    histogram_count(local_data.data(), local_data.size(), min_val, hist);
+    return hist;
+}
+
+// Fase 5 (histograma): suma de los histogramas de la fila
+template <typename Rank>
+vector<Rank> phase5_histogram_allreduce(const vector<Rank>& local_hist, MPI_Comm row_comm) {
+    vector<Rank> global_hist(local_hist.size());
+    TraceScope scope("MPI_Allreduce", "colectiva");
+    MPI_Allreduce(local_hist.data(), global_hist.data(), local_hist.size(),
+                  rank_mpi_type<Rank>(), MPI_SUM, row_comm);
+    return global_hist;
+}
+
+// Fase 4 (histograma): suma prefija y lectura O(1) del ranking global
+// de los grupos propios (igual que el resultado de phase5_reduce en la raíz)
+template <typename Rank, typename Key>
+vector<Rank> phase4_histogram_lookup(
+    const vector<Key>& local_data,
+    vector<Rank>& global_hist,
+    Key min_val, int rank, const Grid& grid
+) {
+    auto [row, col] = rank_to_position(rank, grid);
+    if (!grid.intersects(row, col)) return {};
     
+    histogram_prefix(global_hist);
+    vector<Rank> ranking;
+    for_each_column_group(rank, grid, [&](int start, int count, bool owned) {
+        if (!owned) return;
+        size_t offset = ranking.size();
+        ranking.resize(offset + count);
+        histogram_lookup(local_data.data() + start, count, min_val, global_hist, ranking.data() + offset);
+    });
     return ranking;
 }
 
+// Desempate del motor histograma (fase 6): conteos de cada valor en las
+// columnas anteriores de la fila (MPI_Exscan en orden de columna)
+template <typename Rank>
+vector<Rank> phase5_histogram_exscan(const vector<Rank>& local_hist, int rank, const Grid& grid,
+                                     MPI_Comm row_comm) {
+    auto [row, col] = rank_to_position(rank, grid);
+    
+    vector<Rank> before(local_hist.size(), 0);
+    TraceScope scope("MPI_Exscan", "colectiva");
+    MPI_Exscan(local_hist.data(), before.data(), local_hist.size(), rank_mpi_type<Rank>(), MPI_SUM,
+               row_comm);
+    if (col == 0) fill(before.begin(), before.end(), 0);  // Exscan no define el primero
+    
+    return before;
+}
+
+// Destino único de los grupos propios: (# valores < v) + (iguales en bloques
+// anteriores) + (iguales ya vistos en el propio bloque, propios o no)
+template <typename Rank, typename Key>
+vector<Rank> phase4_histogram_destinations(
+    const vector<Key>& local_data,
+    const vector<Rank>& global_hist,
+    vector<Rank>& before,
+    Key min_val, int rank, const Grid& grid
+) {
+    auto [row, col] = rank_to_position(rank, grid);
+    if (!grid.intersects(row, col)) return {};
+    
+    vector<Rank> less_than(global_hist.size());
+    Rank running = 0;
+    for (size_t v = 0; v < global_hist.size(); v++) {
+        less_than[v] = running;
+        running += global_hist[v];
+    }
+    
+    vector<Rank> destinations;
+    for_each_column_group(rank, grid, [&](int start, int count, bool owned) {
+        for (int i = start; i < start + count; i++) {
+            size_t v = local_data[i] - min_val;
+            Rank destination = less_than[v] + before[v]++;
+            if (owned) destinations.push_back(destination);
+        }
+    });
+    return destinations;
+}
+
+const char* engine_name(Engine engine) {
+    return engine == Engine::HISTOGRAM ? "histogram" : "sort";
+}
+
 // ===== FASE 5: REDUCE HORIZONTAL =====
-vector<int> phase5_reduce(
+// Solo la raíz de la fila recibe el resultado (vacío en los demás procesos)
+template <typename Rank>
+vector<Rank> phase5_reduce(
     const vector<int>& local_ranking,
-    int rank, int p,
+    int rank, const Grid& grid,
     MPI_Comm row_comm
 ) {
-    auto [row, col] = rank_to_position(rank, p);
+    auto [row, col] = rank_to_position(rank, grid);
     
-    vector<int> reduced_ranking(local_ranking.size());
+    vector<Rank> reduced_ranking(is_row_root(rank, grid) ? local_ranking.size() : 0);
+    vector<Rank> wide;
     
+    TraceScope scope("MPI_Reduce", "colectiva");
     MPI_Reduce(
-        local_ranking.data(), reduced_ranking.data(), local_ranking.size(),
-        MPI_INT, MPI_SUM, row, row_comm
+        widen_ranking(local_ranking.data(), local_ranking.size(), wide),
+        reduced_ranking.data(), local_ranking.size(),
+        rank_mpi_type<Rank>(), MPI_SUM, grid.row_root(row), row_comm
+    );
+    
+    return reduced_ranking;
+}
+
+// ===== FASE 5 (ALTERNATIVA): REDUCE-SCATTER EN LA FILA =====
+// En lugar de juntar el ranking del bloque de la fila en su raíz, el proceso
+// (i, j) se queda con la parte j de cols partes (block_part_begin): cada
+// proceso suma y guarda ~N/P enteros y la raíz deja de ser cuello de botella.
+template <typename Rank>
+vector<Rank> phase5_reduce_scatter(
+    const vector<int>& local_ranking,
+    int rank, const Grid& grid,
+    MPI_Comm row_comm
+) {
+    auto [row, col] = rank_to_position(rank, grid);
+    int n = local_ranking.size();
+    
+    vector<int> recv_counts(grid.cols);
+    for (int c = 0; c < grid.cols; c++) {
+        recv_counts[c] = block_part_begin(n, c + 1, grid.cols) - block_part_begin(n, c, grid.cols);
+    }
+    vector<Rank> owned_ranking(recv_counts[col]);
+    vector<Rank> wide;
+    
+    TraceScope scope("MPI_Reduce_scatter", "colectiva");
+    MPI_Reduce_scatter(
+        widen_ranking(local_ranking.data(), n, wide), owned_ranking.data(), recv_counts.data(),
+        rank_mpi_type<Rank>(), MPI_SUM, row_comm
     );
     
-    return reduced_ranking;
+    return owned_ranking;
+}
+
+// ===== FASE 5 (COMPRIMIDA): RANKINGS EMPAQUETADOS =====
+// Un ranking parcial y la suma de la fila valen a lo sumo N (la fila reúne una
+// vez cada bloque de columna), así que entran en width = bit_width(N) bits en
+// lugar de 32 o 64. Los conteos viajan en frames de 64 campos (bit_packing.h)
+// y se suman con un MPI_Op propio que desempaqueta, suma y vuelve a empaquetar.
+// MPI solo corta la reducción en límites de frame, así que ningún campo queda
+// partido; el op deduce el ancho del tamaño del tipo del frame.
+void packed_sum_op(void* in, void* inout, int* len, MPI_Datatype* datatype) {
+    int frame_bytes;
+    MPI_Type_size(*datatype, &frame_bytes);
+    add_packed_frames(static_cast<const uint64_t*>(in), static_cast<uint64_t*>(inout), *len,
+                      frame_bytes / sizeof(uint64_t));
+}
+
+// Reduce a la raíz (scatter = false) o reduce-scatter en partes de
+// block_part_begin (scatter = true, cada parte empieza en un frame nuevo).
+// Devuelve lo mismo que phase5_reduce / phase5_reduce_scatter; bytes recibe
+// {sin comprimir, en la red} de lo que envía este proceso.
+template <typename Rank>
+vector<Rank> phase5_reduce_packed(
+    const vector<int>& local_ranking,
+    bool scatter,
+    int rank, const Grid& grid,
+    MPI_Comm row_comm,
+    double* bytes
+) {
+    auto [row, col] = rank_to_position(rank, grid);
+    int n = local_ranking.size();
+    int width = bit_width(grid.N);
+    int parts = scatter ? grid.cols : 1;
+    
+    vector<int> frame_counts(parts);
+    vector<size_t> part_word(parts + 1, 0);
+    for (int c = 0; c < parts; c++) {
+        frame_counts[c] = packed_frames(block_part_begin(n, c + 1, parts) - block_part_begin(n, c, parts));
+        part_word[c + 1] = part_word[c] + (size_t)frame_counts[c] * width;
+    }
+    
+    vector<uint64_t> packed(part_word[parts], 0);
+    for (int c = 0; c < parts; c++) {
+        int begin = block_part_begin(n, c, parts);
+        pack_bits(block_part_begin(n, c + 1, parts) - begin, width,
+                  [&](size_t i) { return (uint64_t)local_ranking[begin + i]; }, packed.data() + part_word[c]);
+    }
+    
+    MPI_Datatype frame_type;
+    MPI_Type_contiguous(width, MPI_UINT64_T, &frame_type);
+    MPI_Type_commit(&frame_type);
+    MPI_Op sum_op;
+    MPI_Op_create(packed_sum_op, 1, &sum_op);
+    
+    // Parte propia: la c = col con scatter, el bloque entero en la raíz sin scatter
+    int part = scatter ? col : 0;
+    bool receives = scatter || is_row_root(rank, grid);
+    vector<uint64_t> reduced(receives ? part_word[part + 1] - part_word[part] : 0);
+    if (scatter) {
+        TraceScope scope("MPI_Reduce_scatter (empaquetado)", "colectiva");
+        MPI_Reduce_scatter(packed.data(), reduced.data(), frame_counts.data(), frame_type, sum_op, row_comm);
+    } else {
+        TraceScope scope("MPI_Reduce (empaquetado)", "colectiva");
+        MPI_Reduce(packed.data(), reduced.data(), frame_counts[0], frame_type, sum_op, grid.row_root(row),
+                   row_comm);
+    }
+    
+    MPI_Op_free(&sum_op);
+    MPI_Type_free(&frame_type);
+    
+    bytes[0] = (double)n * sizeof(Rank);
+    bytes[1] = (double)packed.size() * sizeof(uint64_t);
+    
+    vector<Rank> reduced_ranking;
+    if (receives) {
+        reduced_ranking.resize(block_part_begin(n, part + 1, parts) - block_part_begin(n, part, parts));
+        unpack_bits(reduced.data(), reduced_ranking.size(), width,
+                    [&](size_t i, uint64_t count) { reduced_ranking[i] = static_cast<Rank>(count); });
+    }
+    return reduced_ranking;
+}
+
+// Valores del bloque broadcast cuyo ranking quedó en este proceso
+template <typename Key>
+vector<Key> owned_values(const vector<Key>& broadcasted, int rank, const Grid& grid) {
+    auto [row, col] = rank_to_position(rank, grid);
+    int n = broadcasted.size();
+    return vector<Key>(broadcasted.begin() + block_part_begin(n, col, grid.cols),
+                       broadcasted.begin() + block_part_begin(n, col + 1, grid.cols));
+}
+
+// Valores de los rankings globales que quedan en este proceso (los que envía
+// en la fase 6): grupos propios con el motor histograma, el tramo propio del
+// bloque broadcast con --scatter o el bloque entero en la raíz de la fila
+template <typename Key>
+vector<Key> owned_ranking_values(Engine engine, bool scattered, const vector<Key>& original_data,
+                                 const vector<Key>& broadcasted, int rank, const Grid& grid) {
+    if (engine == Engine::HISTOGRAM) return owned_group_values(original_data, rank, grid);
+    if (scattered) return owned_values(broadcasted, rank, grid);
+    return is_row_root(rank, grid) ? broadcasted : vector<Key>();
+}
+
+// Tramos globales (inicio, tamaño) de los elementos cuyo ranking global queda en
+// este proceso, en el orden de owned_ranking_values
+vector<pair<long long, int>> owned_ranking_segments(Engine engine, bool scattered, int rank, const Grid& grid) {
+    auto [row, col] = rank_to_position(rank, grid);
+    vector<pair<long long, int>> segments;
+    if (engine == Engine::HISTOGRAM) {
+        for (int g = col; g < grid.size(); g += grid.cols) {
+            if (g % grid.rows == row) segments.push_back({grid.group_begin(g), grid.group_size(g)});
+        }
+        return segments;
+    }
+    if (!scattered && !is_row_root(rank, grid)) return segments;
+    
+    int n = grid.row_block_size(row);
+    int lo = scattered ? block_part_begin(n, col, grid.cols) : 0;
+    int hi = scattered ? block_part_begin(n, col + 1, grid.cols) : n;
+    int start = 0;
+    for (int g = row; g < grid.size(); g += grid.rows) {
+        int a = max(start, lo), b = min(start + grid.group_size(g), hi);
+        if (a < b) segments.push_back({grid.group_begin(g) + (a - start), b - a});
+        start += grid.group_size(g);
+    }
+    return segments;
+}
+
+// ===== MODO PIPELINE: FASES 2-5 SOLAPADAS =====
+// Tramo [lo, hi) del ranking local listo para el reduce no bloqueante. Con
+// int64_t se ensancha en wide, que debe vivir hasta que termine la operación.
+template <typename Rank>
+const Rank* local_ranking_send(const vector<int>& local_ranking, vector<Rank>& wide, int lo, int hi) {
+    if constexpr (is_same_v<Rank, int>) {
+        return local_ranking.data() + lo;
+    } else {
+        copy(local_ranking.begin() + lo, local_ranking.begin() + hi, wide.begin() + lo);
+        return wide.data() + lo;
+    }
+}
+
+// El bloque broadcast se parte en segmentos. Se lanzan todos los MPI_Ibcast
+// antes del sort local, cada segmento se rankea apenas llega y su ranking
+// parcial sale de inmediato con MPI_Ireduce. En las métricas, fase 2 y fase 5
+// pasan a ser el tiempo de comunicación expuesto (esperas en MPI_Wait), y
+// fase 3/4 el cómputo; pipeline_time es el tiempo de pared de toda la región y
+// pipeline_inflight el tiempo con comunicación pendiente: cota superior de la
+// comunicación que pudo quedar oculta detrás del cómputo.
+template <typename Key, typename Rank>
+void pipelined_phases(
+    vector<Key>& local_data,
+    const vector<Key>& row_block,
+    vector<Key>& broadcasted_data,
+    vector<int>& local_ranking,
+    vector<Rank>& reduced_ranking,
+    int segments,
+    RankingKernel kernel, SortBackend sort_backend, bool tiebreak, bool scatter,
+    int rank, const Grid& grid, MPI_Comm row_comm,
+    ThreadPool* pool, EytzingerIndex<Key>& search_index,
+    Metrics& m
+) {
+    auto [row, col] = rank_to_position(rank, grid);
+    int root = grid.row_root(row);
+    int n = static_cast<int>(grid.row_block_size(row));
+    segments = max(1, min(segments, n));
+    auto bound = [&](int k) { return (int)((long long)n * k / segments); };
+    
+    double region_start = MPI_Wtime();
+    double t;
+    
+    // FASE 2: lanzar todos los broadcasts por segmento
+    broadcasted_data.resize(n);
+    if (is_row_root(rank, grid)) broadcasted_data = row_block.empty() ? local_data : row_block;
+    vector<MPI_Request> bcast_requests(segments);
+    double bcast_post = MPI_Wtime();
+    for (int k = 0; k < segments; k++) {
+        MPI_Ibcast(broadcasted_data.data() + bound(k), bound(k + 1) - bound(k), key_mpi_type<Key>(),
+                   root, row_comm, &bcast_requests[k]);
+    }
+    trace().add("MPI_Ibcast (lanzamiento)", "pipeline", bcast_post, MPI_Wtime());
+    
+    // El desempate necesita el bloque de columna en su orden original
+    vector<KeyedEntry<Key>> own_keys;
+    if (tiebreak) {
+        t = MPI_Wtime();
+        own_keys = tiebreak_own_keys(local_data, rank, grid, pool);
+        m.phase4_time += MPI_Wtime() - t;
+        trace().add("Claves de desempate", "pipeline", t, MPI_Wtime());
+    }
+    
+    // FASE 3 (+3b): sort local mientras los broadcasts avanzan
+    t = MPI_Wtime();
+    if (pool) pool->reset_stats();
+    phase3_sort(local_data, sort_backend, pool);
+    if (pool) m.phase3_util = pool->busy_time() / ((MPI_Wtime() - t) * pool->size());
+    m.phase3_time = MPI_Wtime() - t;
+    trace().add("Fase 3 (Sort)", "pipeline", t, t + m.phase3_time);
+    
+    if (kernel == RankingKernel::INDEX) {
+        t = MPI_Wtime();
+        search_index.build(local_data);
+        m.index_time = MPI_Wtime() - t;
+        trace().add("Fase 3b (Índice)", "pipeline", t, t + m.index_time);
+    }
+    
+    // En la diagonal (malla cuadrada) con desempate, la posición estable sale
+    // del bloque entero, que ya es local: se calcula una vez y se reparte
+    vector<int> diagonal_stable;
+    if (tiebreak && grid.square() && col == row) {
+        t = MPI_Wtime();
+        diagonal_stable = phase4_local_ranking_tiebreak(kernel, local_data, search_index, own_keys,
+                                                        broadcasted_data, rank, grid, pool);
+        m.phase4_time += MPI_Wtime() - t;
+        trace().add("Ranking de la diagonal", "pipeline", t, MPI_Wtime());
+    }
+    
+    // FASES 4 y 5 por segmento
+    local_ranking.assign(n, 0);
+    int part_begin = block_part_begin(n, col, grid.cols);
+    int part_end = block_part_begin(n, col + 1, grid.cols);
+    reduced_ranking.assign(scatter ? part_end - part_begin : (col == root ? n : 0), 0);
+    
+    // Con scatter, el segmento [lo, hi) se reparte según las partes de cada
+    // columna que intersecta. Los conteos de cada segmento deben vivir hasta
+    // que termine su operación no bloqueante.
+    auto owned_count = [&](int c, int lo, int hi) {
+        int begin = block_part_begin(n, c, grid.cols), end = block_part_begin(n, c + 1, grid.cols);
+        return max(0, min(hi, end) - max(lo, begin));
+    };
+    vector<vector<int>> recv_counts(scatter ? segments : 0, vector<int>(grid.cols));
+    vector<Rank> wide(is_same_v<Rank, int> ? 0 : n);  // envío ensanchado (Rank = int64_t)
+    vector<MPI_Request> reduce_requests(segments);
+    double busy = 0;
+    double reduce_post = 0;
+    
+    for (int k = 0; k < segments; k++) {
+        int lo = bound(k), hi = bound(k + 1);
+        
+        t = MPI_Wtime();
+        MPI_Wait(&bcast_requests[k], MPI_STATUS_IGNORE);
+        m.phase2_time += MPI_Wtime() - t;
+        trace().add("MPI_Wait (broadcast)", "pipeline", t, MPI_Wtime(), k);
+        if (k == segments - 1) m.pipeline_inflight += MPI_Wtime() - bcast_post;
+        
+        t = MPI_Wtime();
+        if (pool) pool->reset_stats();
+        if (!diagonal_stable.empty()) {
+            copy(diagonal_stable.begin() + lo, diagonal_stable.begin() + hi, local_ranking.begin() + lo);
+        } else {
+            vector<Key> segment(broadcasted_data.begin() + lo, broadcasted_data.begin() + hi);
+            vector<int> ranked = tiebreak
+                ? phase4_local_ranking_tiebreak(kernel, local_data, search_index, own_keys, segment,
+                                                rank, grid, pool, lo)
+                : phase4_rank(kernel, local_data, search_index, segment, pool);
+            copy(ranked.begin(), ranked.end(), local_ranking.begin() + lo);
+        }
+        if (pool) busy += pool->busy_time();
+        m.phase4_time += MPI_Wtime() - t;
+        trace().add("Fase 4 (Ranking)", "pipeline", t, MPI_Wtime(), k);
+        
+        t = MPI_Wtime();
+        if (k == 0) reduce_post = t;
+        const Rank* send = local_ranking_send(local_ranking, wide, lo, hi);
+        if (scatter) {
+            for (int c = 0; c < grid.cols; c++) recv_counts[k][c] = owned_count(c, lo, hi);
+            int offset = min(max(0, lo - part_begin), part_end - part_begin);
+            MPI_Ireduce_scatter(send, reduced_ranking.data() + offset, recv_counts[k].data(),
+                                rank_mpi_type<Rank>(), MPI_SUM, row_comm, &reduce_requests[k]);
+        } else {
+            Rank* recv = (col == root) ? reduced_ranking.data() + lo : nullptr;
+            MPI_Ireduce(send, recv, hi - lo,
+                        rank_mpi_type<Rank>(), MPI_SUM, root, row_comm, &reduce_requests[k]);
+        }
+        
+        // Dar progreso a los reduces pendientes sin bloquear
+        int done;
+        MPI_Testall(k + 1, reduce_requests.data(), &done, MPI_STATUSES_IGNORE);
+        trace().add(scatter ? "MPI_Ireduce_scatter (lanzamiento)" : "MPI_Ireduce (lanzamiento)",
+                    "pipeline", t, MPI_Wtime(), k);
+    }
+    if (pool && m.phase4_time > 0) m.phase4_util = busy / (m.phase4_time * pool->size());
+    
+    // FASE 5: esperar los reduces que sigan en vuelo
+    t = MPI_Wtime();
+    MPI_Waitall(segments, reduce_requests.data(), MPI_STATUSES_IGNORE);
+    m.phase5_time = MPI_Wtime() - t;
+    trace().add("MPI_Waitall (reduce)", "pipeline", t, t + m.phase5_time);
+    m.pipeline_inflight += MPI_Wtime() - reduce_post;
+    
+    m.pipeline_time = MPI_Wtime() - region_start;
+}
+
+// ===== FASE 6: REDISTRIBUCIÓN AL ORDEN GLOBAL =====
+// Con destinos únicos (fase 4 con desempate), cada dueño de rankings envía pares
+// (destino, valor) al proceso dueño del tramo de salida r (el grupo r de la malla)
+// con MPI_Alltoallv. Al final cada proceso tiene su tramo del arreglo ordenado.
+// bytes_sent recibe los bytes que este proceso envió a otros procesos.
+// Par (destino, valor) de la fase 6; viaja como bloque de bytes empaquetado
+// (p. ej. 12 bytes con destino int64_t y clave int en lugar de 16; 5 con
+// destino int y clave char)
+template <typename Rank, typename Key>
+struct __attribute__((packed)) Placement {
+    Rank destination;
+    Key value;
+};
+
+template <typename Rank, typename Key>
+vector<Key> phase6_redistribute(
+    const vector<Key>& values,
+    const vector<Rank>& destinations,
+    const Grid& grid, int rank,
+    double& bytes_sent,
+    MPI_Comm comm
+) {
+    int size = grid.size();
+    
+    // Contar y agrupar los pares por proceso destino (cuentas en pares: caben
+    // en int aunque N no quepa)
+    vector<int> send_counts(size, 0);
+    for (Rank dest : destinations) send_counts[grid.group_of(dest)]++;
+    
+    vector<int> send_displs(size, 0);
+    for (int r = 1; r < size; r++) send_displs[r] = send_displs[r - 1] + send_counts[r - 1];
+    
+    vector<Placement<Rank, Key>> send_buffer(destinations.size());
+    vector<int> cursor = send_displs;
+    for (size_t i = 0; i < destinations.size(); i++) {
+        int owner = grid.group_of(destinations[i]);
+        send_buffer[cursor[owner]++] = {destinations[i], values[i]};
+    }
+    
+    vector<int> recv_counts(size);
+    {
+        TraceScope scope("MPI_Alltoall (conteos)", "colectiva");
+        MPI_Alltoall(send_counts.data(), 1, MPI_INT, recv_counts.data(), 1, MPI_INT, comm);
+    }
+    
+    vector<int> recv_displs(size, 0);
+    for (int r = 1; r < size; r++) recv_displs[r] = recv_displs[r - 1] + recv_counts[r - 1];
+    
+    MPI_Datatype placement_type;
+    MPI_Type_contiguous(sizeof(Placement<Rank, Key>), MPI_BYTE, &placement_type);
+    MPI_Type_commit(&placement_type);
+    
+    vector<Placement<Rank, Key>> recv_buffer(recv_displs[size - 1] + recv_counts[size - 1]);
+    {
+        TraceScope scope("MPI_Alltoallv", "colectiva");
+        MPI_Alltoallv(send_buffer.data(), send_counts.data(), send_displs.data(), placement_type,
+                      recv_buffer.data(), recv_counts.data(), recv_displs.data(), placement_type,
+                      comm);
+    }
+    MPI_Type_free(&placement_type);
+    
+    bytes_sent = (double)(send_buffer.size() - send_counts[rank]) * sizeof(Placement<Rank, Key>);
+    
+    // Cada par cae en una posición distinta del tramo propio
+    vector<Key> sorted_slice(grid.group_size(rank));
+    long long slice_start = grid.group_begin(rank);
+    for (const auto& placed : recv_buffer) {
+        sorted_slice[placed.destination - slice_start] = placed.value;
+    }
+    
+    return sorted_slice;
+}
+
+// Escritura colectiva del arreglo ordenado (binario, mismo tipo de clave que la
+// entrada): el proceso r escribe su tramo (grupo r de la malla) en su offset
+template <typename Key>
+bool write_sorted_output(const string& path, const vector<Key>& sorted_slice, const Grid& grid, int rank,
+                         MPI_Comm comm) {
+    MPI_File fh;
+    if (MPI_File_open(comm, path.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY,
+                      MPI_INFO_NULL, &fh) != MPI_SUCCESS) {
+        if (rank == 0) cerr << "ERROR: no se pudo crear " << path << "\n";
+        return false;
+    }
+    
+    MPI_File_set_size(fh, (MPI_Offset)grid.N * sizeof(Key));
+    MPI_Offset offset = (MPI_Offset)grid.group_begin(rank) * sizeof(Key);
+    TraceScope scope("MPI_File_write_at_all", "io");
+    int status = MPI_File_write_at_all(fh, offset, sorted_slice.data(), sorted_slice.size(),
+                                       key_mpi_type<Key>(), MPI_STATUS_IGNORE);
+    MPI_File_close(&fh);
+    
+    if (status != MPI_SUCCESS) {
+        if (rank == 0) cerr << "ERROR: falló la escritura de " << path << "\n";
+        return false;
+    }
+    return true;
+}
+
+// ===== VERIFICACIÓN DISTRIBUIDA (--verify) =====
+// Comprueba el ranking global sin juntarlo en ningún proceso, con trabajo
+// O(N/P log N/P) por proceso y comunicación del orden de la fase 6, así que se
+// puede dejar activa en corridas de rendimiento (corre fuera de Tp).
+//   cobertura    la malla tiene N rankings, cada uno en [1, N] ([0, N) con -s)
+//   conteos      VERIFY_SAMPLES valores de cada dueño de rankings son cortes que
+//                parten el dominio en clases (tramos abiertos y los cortes
+//                mismos). El proceso (i, j) cuenta la parte i de rows de su
+//                bloque de columna: la malla cuenta cada elemento una vez y sale
+//                el conteo exacto de cada clase. Cada par (valor, ranking) viaja
+//                al dueño de su posición en el orden global (tramos de N/P),
+//                que los ordena por ranking (conteo) y compara cada ranking con
+//                la suma prefija exacta (# <= v, o los destinos de [# < v, # <= v)
+//                con -s). Los pares de cada clase, sumados entre procesos, deben
+//                dar el conteo
+//   valores      el checksum de los valores de los rankings (lo que llegó por
+//                el broadcast) es el de los bloques de columna
+//   permutación  con -s, la suma y el checksum de los destinos son los de 0..N-1
+//   salida       con -s, el arreglo ordenado está en orden (también entre
+//                procesos) y tiene el mismo checksum de valores que la entrada
+//   regenerados  sin --input, los cortes y un tramo de VERIFY_BLOCK elementos
+//                del bloque de columna coinciden con el generador
+const int VERIFY_SAMPLES = 16;
+const int VERIFY_BLOCK = 256;
+
+// Resultado global: igual en todos los procesos
+struct VerifyReport {
+    long long expected;        // N
+    long long rankings;        // rankings en la malla
+    long long out_of_range;
+    long long wrong;           // rankings distintos de la suma prefija exacta
+    long long bad_classes;     // clases con distinta cantidad de rankings que de elementos
+    long long classes;
+    bool values_ok;            // checksum de valores de los rankings = el de la entrada
+    bool destinations;         // rankings = destinos únicos (-s)
+    bool permutation_ok;       // solo con destinos
+    bool output_checksum_ok;   // solo con destinos
+    long long output_disorder; // pares consecutivos del arreglo ordenado fuera de orden
+    long long regen_samples, regen_mismatch;  // 0 muestras con --input
+    double time;
+    
+    bool ok() const {
+        return rankings == expected && out_of_range == 0 && wrong == 0 && bad_classes == 0 && values_ok &&
+               (!destinations || (permutation_ok && output_checksum_ok && output_disorder == 0)) &&
+               regen_mismatch == 0;
+    }
+};
+
+// Finalizador de splitmix64: checksums de sumas que no se cancelan entre elementos
+inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+template <typename Key>
+uint64_t key_checksum(Key value) {
+    uint64_t bits = 0;
+    memcpy(&bits, &value, sizeof(Key));
+    return mix64(bits);
+}
+
+// Posición global del elemento k de la concatenación de segments
+long long segment_position(const vector<pair<long long, int>>& segments, long long k) {
+    for (const auto& [begin, count] : segments) {
+        if (k < count) return begin + k;
+        k -= count;
+    }
+    return -1;
+}
+
+// values/ranking: rankings propios (reduced_ranking) y sus valores, en las
+// posiciones globales owned_segments; column_block: bloque de columna en el
+// orden original; sorted_slice: tramo de la fase 6 (destinations = true).
+// regenerate(pos) devuelve el elemento global pos según el generador (vacío
+// con --input). Colectiva en comm.
+template <typename Key, typename Rank>
+VerifyReport verify_ranking(
+    const vector<Key>& values,
+    const vector<Rank>& ranking,
+    const vector<pair<long long, int>>& owned_segments,
+    const vector<Key>& column_block,
+    const vector<Key>& sorted_slice,
+    bool destinations,
+    const function<Key(long long)>& regenerate,
+    int rank, const Grid& grid, MPI_Comm comm
+) {
+    TraceScope scope("Verificación", "verificación");
+    double start = MPI_Wtime();
+    auto [row, col] = rank_to_position(rank, grid);
+    int size = grid.size();
+    long long N = grid.N;
+    size_t n = values.size();
+    
+    // Cortes: los mismos en todos los procesos, ordenados y sin repetir
+    vector<size_t> picks;
+    for (int s = 0; s < VERIFY_SAMPLES && n > 0; s++) picks.push_back((2 * s + 1) * n / (2 * VERIFY_SAMPLES));
+    vector<Key> samples;
+    for (size_t p : picks) samples.push_back(values[p]);
+    int sample_count = samples.size();
+    vector<int> sample_counts(size), sample_displs(size, 0);
+    MPI_Allgather(&sample_count, 1, MPI_INT, sample_counts.data(), 1, MPI_INT, comm);
+    for (int r = 1; r < size; r++) sample_displs[r] = sample_displs[r - 1] + sample_counts[r - 1];
+    vector<Key> cuts(sample_displs[size - 1] + sample_counts[size - 1]);
+    MPI_Allgatherv(samples.data(), sample_count, key_mpi_type<Key>(), cuts.data(), sample_counts.data(),
+                   sample_displs.data(), key_mpi_type<Key>(), comm);
+    sort(cuts.begin(), cuts.end());
+    cuts.erase(unique(cuts.begin(), cuts.end()), cuts.end());
+    
+    // Clase de un valor: 2j entre los cortes j - 1 y j (abierto), 2j + 1 igual al
+    // corte j
+    size_t classes = 2 * cuts.size() + 1;
+    auto class_of = [&](Key v) {
+        size_t j = lower_bound(cuts.begin(), cuts.end(), v) - cuts.begin();
+        return (j < cuts.size() && !(v < cuts[j])) ? 2 * j + 1 : 2 * j;
+    };
+    auto in_class = [&](Key v, size_t c) {
+        size_t j = c / 2;
+        if (c % 2 == 1) return !(v < cuts[j]) && !(cuts[j] < v);
+        return (j == 0 || cuts[j - 1] < v) && (j == cuts.size() || v < cuts[j]);
+    };
+    
+    // Conteo exacto por clase: cada proceso cuenta la parte row de rows de su
+    // bloque de columna. below[c]: elementos de las clases < c
+    // sums: {destinos, 0..N-1} (suma y checksum) y checksums de valores de la
+    // entrada, de los rankings y de la salida
+    uint64_t sums[7] = {0, 0, 0, 0, 0, 0, 0};
+    vector<long long> class_counts(classes, 0);
+    int m = column_block.size();
+    for (int i = block_part_begin(m, row, grid.rows); i < block_part_begin(m, row + 1, grid.rows); i++) {
+        class_counts[class_of(column_block[i])]++;
+        sums[4] += key_checksum(column_block[i]);
+    }
+    MPI_Allreduce(MPI_IN_PLACE, class_counts.data(), classes, MPI_LONG_LONG, MPI_SUM, comm);
+    vector<long long> below(classes + 1, 0);
+    for (size_t c = 0; c < classes; c++) below[c + 1] = below[c] + class_counts[c];
+    
+    // Locales, sumados al final: {rankings, fuera de rango, incorrectos, clases
+    // descuadradas, desorden de la salida, muestras regeneradas, discrepancias}
+    long long local[7] = {(long long)n, 0, 0, 0, 0, 0, 0};
+    
+    // Posiciones del orden global repartidas en tramos iguales: el proceso p
+    // verifica [bounds[p], bounds[p + 1]). Cada par va al dueño de su posición
+    // (el destino con -s, ranking - 1 sin -s), así que con rankings correctos
+    // cada proceso recibe O(N/P) pares aunque haya pocos valores distintos. Sin
+    // -s todos los pares de una clase de un solo valor (igual a un corte) tienen
+    // el ranking below[c + 1]: se comprueban en el origen, sin viajar
+    vector<long long> bounds(size + 1);
+    for (int p = 0; p <= size; p++) bounds[p] = (long long)p * N / size;
+    long long offset = destinations ? 0 : 1;  // ranking de la posición 0
+    vector<long long> class_pairs(classes, 0);  // pares por clase vistos por este proceso
+    vector<int> send_counts(size, 0);
+    vector<int> pair_home(n, -1);
+    for (size_t i = 0; i < n; i++) {
+        long long r = ranking[i];
+        local[1] += destinations ? (r < 0 || r >= N) : (r < 1 || r > N);
+        sums[5] += key_checksum(values[i]);
+        size_t c = class_of(values[i]);
+        long long position = r - offset;
+        if (!destinations && c % 2 == 1) {
+            class_pairs[c]++;
+            local[2] += r != below[c + 1];
+        } else if (position < 0 || position >= N) {
+            local[2]++;
+        } else {
+            pair_home[i] = upper_bound(bounds.begin(), bounds.end(), position) - bounds.begin() - 1;
+            send_counts[pair_home[i]]++;
+        }
+    }
+    vector<int> send_displs(size, 0);
+    for (int r = 1; r < size; r++) send_displs[r] = send_displs[r - 1] + send_counts[r - 1];
+    vector<Placement<Rank, Key>> send_buffer(send_displs[size - 1] + send_counts[size - 1]);
+    vector<int> cursor = send_displs;
+    for (size_t i = 0; i < n; i++) {
+        if (pair_home[i] >= 0) send_buffer[cursor[pair_home[i]]++] = {ranking[i], values[i]};
+    }
+    
+    vector<int> recv_counts(size), recv_displs(size, 0);
+    MPI_Alltoall(send_counts.data(), 1, MPI_INT, recv_counts.data(), 1, MPI_INT, comm);
+    for (int r = 1; r < size; r++) recv_displs[r] = recv_displs[r - 1] + recv_counts[r - 1];
+    MPI_Datatype placement_type;
+    MPI_Type_contiguous(sizeof(Placement<Rank, Key>), MPI_BYTE, &placement_type);
+    MPI_Type_commit(&placement_type);
+    vector<Placement<Rank, Key>> received(recv_displs[size - 1] + recv_counts[size - 1]);
+    MPI_Alltoallv(send_buffer.data(), send_counts.data(), send_displs.data(), placement_type,
+                  received.data(), recv_counts.data(), recv_displs.data(), placement_type, comm);
+    MPI_Type_free(&placement_type);
+    
+    // Los pares del tramo propio se ordenan por posición con un conteo
+    // O(pares + tramo). En orden de ranking, cada ranking debe tener un solo
+    // valor, dentro de la clase que le corresponde y mayor que el anterior,
+    // repetido # <= v - # < v veces (con -s, un par por destino y valores no
+    // decrecientes)
+    long long lo = bounds[rank];
+    long long span = bounds[rank + 1] - lo;
+    auto slot_of = [&](const Placement<Rank, Key>& p) { return (long long)p.destination - offset - lo; };
+    vector<int> slot_begin(span + 1, 0);
+    for (const auto& p : received) slot_begin[slot_of(p) + 1]++;
+    for (long long s = 0; s < span; s++) slot_begin[s + 1] += slot_begin[s];
+    vector<Key> by_rank(slot_begin[span]);
+    vector<int> slot_cursor(slot_begin.begin(), slot_begin.end() - 1);
+    for (const auto& p : received) by_rank[slot_cursor[slot_of(p)]++] = p.value;
+    
+    // El valor anterior al primero del tramo puede estar en otro proceso: cada
+    // uno publica su último ranking (-1 si no recibió pares) y su valor
+    struct Tail {
+        long long ranking;
+        Key value;
+    };
+    Tail tail = {-1, Key()};
+    for (long long s = span; s > 0; s--) {
+        if (slot_begin[s - 1] < slot_begin[s]) {
+            tail = {lo + s - 1 + offset, by_rank.back()};
+            break;
+        }
+    }
+    vector<Tail> tails(size);
+    MPI_Allgather(&tail, sizeof(Tail), MPI_BYTE, tails.data(), sizeof(Tail), MPI_BYTE, comm);
+    Tail before = {-1, Key()};
+    for (int p = rank - 1; p >= 0 && before.ranking < 0; p--) before = tails[p];
+    
+    long long previous = max(0LL, before.ranking);  // ranking anterior (# <= v del valor anterior)
+    bool has_previous = before.ranking >= 0;
+    Key last = before.value;
+    size_t current = 0;
+    for (long long s = 0; s < span; s++) {
+        int begin = slot_begin[s], end = slot_begin[s + 1];
+        if (begin == end) continue;
+        long long position = lo + s, r = position + offset;
+        while (below[current + 1] <= position) current++;
+        // Sin -s las clases de un solo valor no viajan: el anterior cierra en below
+        previous = max(previous, below[current]);
+        Key v = by_rank[begin];
+        long long count = end - begin;
+        bool ok = destinations ? count == 1 : count == r - previous;
+        for (int k = begin + 1; k < end && ok; k++) ok = !(v < by_rank[k]) && !(by_rank[k] < v);
+        if (has_previous) ok = ok && (destinations ? !(v < last) : last < v);
+        if (in_class(v, current)) {
+            class_pairs[current] += count;
+        } else {
+            class_pairs[class_of(v)] += count;
+            ok = false;
+        }
+        if (!ok) local[2] += count;
+        previous = r;
+        last = v;
+        has_previous = true;
+    }
+    // Clases descuadradas: las partes de todos los procesos contra el conteo
+    // exacto (las cuenta un solo proceso)
+    MPI_Allreduce(MPI_IN_PLACE, class_pairs.data(), classes, MPI_LONG_LONG, MPI_SUM, comm);
+    if (rank == 0) {
+        for (size_t c = 0; c < classes; c++) local[3] += class_pairs[c] != class_counts[c];
+    }
+    
+    // Salida ordenada: orden interno y frontera con el primero del siguiente proceso
+    if (destinations) {
+        for (size_t i = 1; i < sorted_slice.size(); i++) local[4] += sorted_slice[i] < sorted_slice[i - 1];
+        Key next_first = Key();
+        MPI_Sendrecv(sorted_slice.data(), sorted_slice.empty() ? 0 : 1, key_mpi_type<Key>(),
+                     rank > 0 ? rank - 1 : MPI_PROC_NULL, 7002,
+                     &next_first, 1, key_mpi_type<Key>(), rank + 1 < size ? rank + 1 : MPI_PROC_NULL, 7002,
+                     comm, MPI_STATUS_IGNORE);
+        if (rank + 1 < size && !sorted_slice.empty() && next_first < sorted_slice.back()) local[4]++;
+        
+        for (Rank r : ranking) {
+            sums[0] += (uint64_t)r;
+            sums[1] += mix64((uint64_t)r);
+        }
+        for (long long i = grid.group_begin(rank); i < grid.group_begin(rank + 1); i++) {
+            sums[2] += (uint64_t)i;
+            sums[3] += mix64((uint64_t)i);
+        }
+        for (Key v : sorted_slice) sums[6] += key_checksum(v);
+    }
+    
+    // Regenerados: los cortes propios y un tramo del bloque de columna que
+    // depende del proceso (cada fila de la columna mira otro)
+    if (regenerate) {
+        for (size_t p : picks) {
+            local[5]++;
+            local[6] += !(regenerate(segment_position(owned_segments, p)) == values[p]);
+        }
+        vector<pair<long long, int>> column_segments;
+        for (int g = col; g < size; g += grid.cols) column_segments.push_back({grid.group_begin(g), grid.group_size(g)});
+        int block = min(VERIFY_BLOCK, m);
+        int first = m > block ? mix64(rank) % (m - block + 1) : 0;
+        for (int p = first; p < first + block; p++) {
+            local[5]++;
+            local[6] += !(regenerate(segment_position(column_segments, p)) == column_block[p]);
+        }
+    }
+    
+    long long global[7];
+    MPI_Allreduce(local, global, 7, MPI_LONG_LONG, MPI_SUM, comm);
+    MPI_Allreduce(MPI_IN_PLACE, sums, 7, MPI_UINT64_T, MPI_SUM, comm);
+    
+    VerifyReport report = {};
+    report.expected = N;
+    report.rankings = global[0];
+    report.out_of_range = global[1];
+    report.wrong = global[2];
+    report.bad_classes = global[3];
+    report.output_disorder = global[4];
+    report.regen_samples = global[5];
+    report.regen_mismatch = global[6];
+    report.classes = classes;
+    report.destinations = destinations;
+    report.values_ok = sums[4] == sums[5];
+    report.permutation_ok = sums[0] == sums[2] && sums[1] == sums[3];
+    report.output_checksum_ok = sums[6] == sums[5];
+    report.time = MPI_Wtime() - start;
+    return report;
+}
+
+void print_verification(int rank, const VerifyReport& v) {
+    if (rank != 0) return;
+    auto status = [](bool ok) { return ok ? "OK" : "FALLA"; };
+    cout << "Verificación (--verify): " << status(v.ok()) << " en " << fixed << setprecision(3)
+         << (v.time * 1000) << " ms\n";
+    cout << "  Cobertura:         " << status(v.rankings == v.expected && v.out_of_range == 0) << " ("
+         << v.rankings << " de " << v.expected << " rankings, " << v.out_of_range << " fuera de rango)\n";
+    cout << "  Conteos prefijos:  " << status(v.wrong == 0 && v.bad_classes == 0) << " (" << v.classes
+         << " clases, " << v.wrong << " rankings incorrectos, " << v.bad_classes << " clases descuadradas)\n";
+    cout << "  Valores:           " << status(v.values_ok) << " (checksum de los rankeados "
+         << (v.values_ok ? "igual" : "distinto") << " al de la entrada)\n";
+    if (v.destinations) {
+        cout << "  Permutación:       " << status(v.permutation_ok) << " (suma y checksum de destinos)\n";
+        cout << "  Salida ordenada:   " << status(v.output_checksum_ok && v.output_disorder == 0) << " ("
+             << v.output_disorder << " pares fuera de orden, checksum de valores "
+             << (v.output_checksum_ok ? "igual" : "distinto") << ")\n";
+    }
+    if (v.regen_samples > 0) {
+        cout << "  Regenerados:       " << status(v.regen_mismatch == 0) << " (" << v.regen_samples
+             << " muestras, " << v.regen_mismatch << " distintas)\n";
+    } else {
+        cout << "  Regenerados:       omitido (--input)\n";
+    }
+}
+
+// ===== CÁLCULO DE FLOPs =====
+long long calculate_flops(const Grid& grid) {
+    // Trabajo por proceso
+    long long n = grid.N / grid.cols;  // Elementos por proceso (bloque de columna)
+    long long q = grid.N / grid.rows;  // Consultas por proceso (bloque de la fila)
+    
+    // Sort: n log(n) comparaciones/swaps
+    long long sort_ops = n * (long long)log2(n);
+    
+    // Ranking: q búsquedas binarias, cada una O(log n)
+    long long ranking_ops = q * (long long)log2(n);
+    
+    // Total por proceso
+    long long ops_per_process = sort_ops + ranking_ops;
+    
+    // Total en el sistema (P procesos)
+    long long total_ops = ops_per_process * grid.size();
+    
+    return total_ops;
+}
+
+long long calculate_flops_histogram(const Grid& grid, long long range) {
+    long long n = grid.N / grid.cols;
+    
+    // Conteo (n) + suma prefija (rango) + lectura O(1) del ranking (n)
+    long long ops_per_process = 2LL * n + range;
+    
+    return ops_per_process * grid.size();
+}
+
+// ===== TIEMPOS POR PROCESO (--no-barriers) =====
+// Sin barreras entre fases, cada proceso mide sus propias fases y las Metrics
+// de todos se juntan una sola vez al final en rank 0. El desbalance de una
+// fase es máx / media (1 = todos tardaron lo mismo).
+struct PhaseStats {
+    double min, mean, max;
+    double imbalance() const { return mean > 0 ? max / mean : 1.0; }
+};
+
+PhaseStats phase_stats(const vector<Metrics>& per_rank, double Metrics::* field) {
+    PhaseStats stats = {per_rank[0].*field, 0, per_rank[0].*field};
+    for (const Metrics& m : per_rank) {
+        stats.min = min(stats.min, m.*field);
+        stats.max = max(stats.max, m.*field);
+        stats.mean += m.*field;
+    }
+    stats.mean /= per_rank.size();
+    return stats;
+}
+
+// Fases reportadas: {etiqueta, nombre en el CSV, campo}
+struct TimedPhase {
+    const char* label;
+    const char* csv_name;
+    double Metrics::* field;
+};
+
+const TimedPhase TIMED_PHASES[] = {
+    {"Fase 1 (Input)", "p1", &Metrics::phase1_time},
+    {"Fase 2 (Bcast)", "p2", &Metrics::phase2_time},
+    {"Fase 3 (Sort/Hist.)", "p3", &Metrics::phase3_time},
+    {"Fase 3b (Índice)", "p3b", &Metrics::index_time},
+    {"Fase 4 (Ranking)", "p4", &Metrics::phase4_time},
+    {"Fase 5 (Reduce)", "p5", &Metrics::phase5_time},
+    {"Fase 6 (Redist.)", "p6", &Metrics::phase6_time},
+    {"Pipeline (F2-F5)", "pipeline", &Metrics::pipeline_time},
+    {"Comm en vuelo", "inflight", &Metrics::pipeline_inflight},
+    {"Cómputo", "compute", &Metrics::compute_time},
+    {"Comunicación", "comm", &Metrics::comm_time},
+    {"Total", "total", &Metrics::total_time},
+};
+
+// ===== CONTADORES POR FASE (--counters) =====
+// Fases con contadores propios: las primeras COUNTED_PHASES de TIMED_PHASES.
+// Con --pipeline las fases 2-5 se solapan y solo cuenta la región entera.
+enum CountedPhase {
+    CP_INPUT, CP_BCAST, CP_SORT, CP_INDEX, CP_RANKING, CP_REDUCE, CP_REDISTRIBUTE, CP_PIPELINE,
+    COUNTED_PHASES
+};
+
+// Deltas de perf_counters.h por fase, sumados en todos los procesos
+struct PhaseCounters {
+    double values[COUNTED_PHASES][PERF_COUNTERS];
+    CounterSource sources[PERF_COUNTERS];
+};
+
+// Suma los contadores de todos los procesos en rank 0. Un contador solo se
+// reporta si todos los procesos lo midieron con el mismo origen.
+PhaseCounters reduce_counters(const PhaseCounters& local, MPI_Comm comm) {
+    PhaseCounters total = local;
+    TraceScope scope("MPI_Reduce (contadores)", "métricas");
+    MPI_Reduce(local.values, total.values, COUNTED_PHASES * PERF_COUNTERS, MPI_DOUBLE, MPI_SUM, 0, comm);
+    
+    int bounds[2 * PERF_COUNTERS], global[2 * PERF_COUNTERS];  // {máx, -mín} de cada origen
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+        bounds[2 * c] = static_cast<int>(local.sources[c]);
+        bounds[2 * c + 1] = -static_cast<int>(local.sources[c]);
+    }
+    MPI_Allreduce(bounds, global, 2 * PERF_COUNTERS, MPI_INT, MPI_MAX, comm);
+    for (int c = 0; c < PERF_COUNTERS; c++) {
+        total.sources[c] = (global[2 * c] == -global[2 * c + 1]) ? static_cast<CounterSource>(global[2 * c])
+                                                                 : CounterSource::NONE;
+    }
+    return total;
+}
+
+// setw cuenta bytes: completa label hasta width caracteres contando UTF-8
+string pad_label(const char* label, size_t width) {
+    string padded = label;
+    size_t chars = 0;
+    for (unsigned char c : padded) chars += (c & 0xC0) != 0x80;
+    return padded + string(width > chars ? width - chars : 0, ' ');
+}
+
+// Junta las Metrics de todos los procesos en rank 0 (vacío en los demás)
+vector<Metrics> gather_metrics(const Metrics& local, int rank, int size, MPI_Comm comm) {
+    vector<Metrics> per_rank(rank == 0 ? size : 0);
+    TraceScope scope("MPI_Gather (métricas)", "métricas");
+    MPI_Gather(&local, METRIC_FIELDS, MPI_DOUBLE, per_rank.data(), METRIC_FIELDS, MPI_DOUBLE,
+               0, comm);
+    return per_rank;
+}
+
+// ===== IMPRESIÓN DE MÉTRICAS =====
+// value_range: cantidad de valores de [min, max] (solo motor histograma).
+// per_rank: Metrics de cada proceso con --no-barriers (vacío si no).
+// counters: contadores por fase con --counters (nullptr si no).
+// choices: kernels elegidos por cada proceso con --sort/--ranking auto (vacío si no)
+void print_metrics(int rank, const Grid& grid, const Metrics& m, double Ts, bool verbose,
+                   RankingKernel kernel, Engine engine, long long value_range,
+                   SortBackend sort_backend, int threads, bool scattered, int rank_bits,
+                   const char* key_name, int key_bytes, const vector<Metrics>& per_rank,
+                   const PhaseCounters* counters, const vector<KernelChoice>& choices) {
+    int size = grid.size();
+    long long N = grid.N;
+    
+    if (rank == 0) {
+        cout << "\n" << string(70, '=') << "\n";
+        cout << "RANKING SORT PARALELO - MÉTRICAS DE PERFORMANCE\n";
+        cout << string(70, '=') << "\n";
+        
+        cout << fixed << setprecision(3);
+        
+        // Configuración
+        cout << "Configuración:\n";
+        cout << "  N (elementos):     " << N << "\n";
+        cout << "  P (procesos):      " << size << " (malla " << grid.rows << "×" << grid.cols << ")\n";
+        cout << "  Elementos/proceso: " << (N / grid.cols);
+        if (N % grid.size() != 0) cout << " (bloques desparejos)";
+        cout << "\n";
+        cout << "  Hilos/proceso:     " << threads << "\n";
+        cout << "  Motor:             " << engine_name(engine) << "\n";
+        cout << "  Clave:             " << key_name << " (" << key_bytes << " B/elemento)\n";
+        cout << "  Ranking global:    int" << rank_bits << "\n";
+        if (engine == Engine::SORT) {
+            vector<const char*> shapes, sorts, kernels;
+            for (const KernelChoice& c : choices) {
+                shapes.push_back(data_shape_name(c.shape));
+                sorts.push_back(sort_backend_name(c.sort));
+                kernels.push_back(ranking_kernel_name(c.ranking));
+            }
+            cout << "  Sort local:        " << sort_backend_name(sort_backend);
+            if (sort_backend == SortBackend::AUTO) cout << " → " << choice_summary(sorts);
+            cout << "\n";
+            cout << "  Kernel ranking:    " << ranking_kernel_name(kernel);
+            if (kernel == RankingKernel::AUTO) cout << " → " << choice_summary(kernels);
+            cout << "\n";
+            if (!choices.empty()) {
+                cout << "  Forma (muestra):   " << choice_summary(shapes) << "\n";
+                if (verbose) {
+                    for (int r = 0; r < size; r++) {
+                        cout << "    Proceso " << r << ": " << shapes[r] << " → sort " << sorts[r]
+                             << ", ranking " << kernels[r] << "\n";
+                    }
+                }
+            }
+        }
+        cout << "\n";
+        
+        // Tiempos
+        cout << "Tiempos:\n";
+        cout << "  Total (Tp):        " << (m.total_time * 1000) << " ms\n";
+        cout << "  - Cómputo:         " << (m.compute_time * 1000) << " ms ("
+             << (m.compute_time/m.total_time*100) << "%)\n";
+        cout << "  - Comunicación:    " << (m.comm_time * 1000) << " ms ("
+             << (m.comm_time/m.total_time*100) << "%)\n";
+        if (m.pipeline_time > 0) {
+            double exposed = m.phase2_time + m.phase5_time;
+            cout << "  Pipeline (F2-F5):  " << (m.pipeline_time * 1000) << " ms (comm expuesta "
+                 << (exposed * 1000) << " ms de una ventana de "
+                 << (m.pipeline_inflight * 1000) << " ms con comm en vuelo)\n";
+        }
+        if (m.phase6_time > 0) {
+            cout << "  Redistribución:    " << (m.phase6_time * 1000) << " ms ("
+                 << (m.phase6_bytes / 1e6) << " MB enviados)\n";
+        }
+        if (m.output_time > 0) {
+            cout << "  Escritura salida:  " << (m.output_time * 1000) << " ms ("
+                 << ((double)N * key_bytes / m.output_time / 1e9) << " GB/s)\n";
+        }
+        if (m.input_bytes > 0) {
+            cout << "  Carga (archivo):   " << (m.phase1_time * 1000) << " ms ("
+                 << (m.input_bytes / m.phase1_time / 1e9) << " GB/s)\n";
+        }
+        
+        // Distribución por proceso: sin barreras, el total es el del proceso más lento
+        if (!per_rank.empty()) {
+            cout << "\nTiempos por proceso (sin barreras, ms):\n";
+            cout << "                             mín     media       máx  desbalance\n";
+            for (const TimedPhase& phase : TIMED_PHASES) {
+                PhaseStats stats = phase_stats(per_rank, phase.field);
+                if (stats.max == 0) continue;
+                cout << "  " << pad_label(phase.label, 20)
+                     << setw(10) << (stats.min * 1000) << setw(10) << (stats.mean * 1000)
+                     << setw(10) << (stats.max * 1000) << setw(10) << stats.imbalance() << "x\n";
+            }
+        }
+        
+        // Volumen de las colectivas de las fases 2 y 5 (comprimido con --compress)
+        if (m.phase2_bytes > 0) {
+            cout << "\nBytes en la red (todos los procesos):\n";
+            cout << "  Fase 2 (Bcast):    " << (m.phase2_bytes / 1e6) << " MB -> "
+                 << (m.phase2_wire_bytes / 1e6) << " MB (" << (m.phase2_bytes / m.phase2_wire_bytes) << "x)\n";
+            cout << (scattered ? "  Fase 5 (Red-Sc.):  " : "  Fase 5 (Reduce):   ")
+                 << (m.phase5_bytes / 1e6) << " MB -> "
+                 << (m.phase5_wire_bytes / 1e6) << " MB (" << (m.phase5_bytes / m.phase5_wire_bytes) << "x)\n";
+        }
+        
+        // Utilización del pool: tiempo ocupado / (tiempo de la fase × hilos)
+        if (threads > 1 && engine == Engine::SORT) {
+            cout << "\nUtilización de hilos:\n";
+            cout << "  Fase 3 (Sort):     " << (m.phase3_util * 100) << "%\n";
+            cout << "  Fase 4 (Ranking):  " << (m.phase4_util * 100) << "%\n";
+        }
+        
+        // Contadores: IPC bajo con muchos fallos de salto apunta a predicción;
+        // con muchos fallos de LLC, a memoria
+        if (counters) {
+            bool ipc = counters->sources[PERF_CYCLES] == CounterSource::HARDWARE &&
+                       counters->sources[PERF_INSTRUCTIONS] == CounterSource::HARDWARE;
+            cout << "\nContadores por fase (todos los procesos):\n";
+            cout << "  Origen:";
+            for (int c = 0; c < PERF_COUNTERS; c++) {
+                cout << " " << PERF_COUNTER_INFO[c].label << "="
+                     << counter_source_name(counters->sources[c]);
+            }
+            if (counters->sources[PERF_CYCLES] != CounterSource::HARDWARE &&
+                counters->sources[PERF_CYCLES] != CounterSource::NONE) {
+                cout << " (ciclos en ns de CPU)";
+            }
+            cout << "\n";
+            cout << "                              ciclos     instrucc.    IPC    fallos LLC  fallos salto   fallos pág.\n";
+            cout << setprecision(0);
+            for (int p = 0; p < COUNTED_PHASES; p++) {
+                const double* v = counters->values[p];
+                if (v[PERF_CYCLES] == 0 && v[PERF_PAGE_FAULTS] == 0) continue;
+                cout << "  " << pad_label(TIMED_PHASES[p].label, 20);
+                for (int c = 0; c < PERF_COUNTERS; c++) {
+                    if (counters->sources[c] == CounterSource::NONE) {
+                        cout << setw(14) << "-";
+                    } else {
+                        cout << setw(14) << v[c];
+                    }
+                    if (c == PERF_INSTRUCTIONS) {
+                        if (ipc && v[PERF_CYCLES] > 0) {
+                            cout << setw(7) << setprecision(2) << v[PERF_INSTRUCTIONS] / v[PERF_CYCLES]
+                                 << setprecision(0);
+                        } else {
+                            cout << setw(7) << "-";
+                        }
+                    }
+                }
+                cout << "\n";
+            }
+            cout << setprecision(3);
+        }
+        
+        if (verbose && engine == Engine::HISTOGRAM) {
+            cout << "\n  Desglose detallado:\n";
+            cout << "    Fase 1 (" << (m.input_bytes > 0 ? "Archivo):    " : "Input):      ")
+                 << (m.phase1_time * 1000) << " ms\n";
+            cout << "    Fase 3 (Histograma): " << (m.phase3_time * 1000) << " ms\n";
+            cout << "    Fase 5 (Allreduce):  " << (m.phase5_time * 1000) << " ms\n";
+            cout << "    Fase 4 (Prefijo):    " << (m.phase4_time * 1000) << " ms\n";
+            if (m.phase6_time > 0) {
+                cout << "    Fase 6 (Redistrib.): " << (m.phase6_time * 1000) << " ms\n";
+            }
+        } else if (verbose) {
+            cout << "\n  Desglose detallado:\n";
+            cout << "    Fase 1 (" << (m.input_bytes > 0 ? "Archivo):  " : "Input):    ")
+                 << (m.phase1_time * 1000) << " ms\n";
+            cout << "    Fase 2 (Bcast):    " << (m.phase2_time * 1000) << " ms\n";
+            cout << "    Fase 3 (Sort):     " << (m.phase3_time * 1000) << " ms\n";
+            if (kernel == RankingKernel::INDEX || kernel == RankingKernel::AUTO) {
+                cout << "    Fase 3b (Índice):  " << (m.index_time * 1000) << " ms\n";
+            }
+            cout << "    Fase 4 (Ranking):  " << (m.phase4_time * 1000) << " ms ["
+                 << ranking_kernel_name(kernel) << "]\n";
+            cout << (scattered ? "    Fase 5 (Red-Sc.):  " : "    Fase 5 (Reduce):   ")
+                 << (m.phase5_time * 1000) << " ms\n";
+            if (m.phase6_time > 0) {
+                cout << "    Fase 6 (Redist.):  " << (m.phase6_time * 1000) << " ms\n";
+            }
+        }
+        
+        // Rendimiento (si Ts disponible)
+        if (Ts > 0) {
+            double speedup = Ts / m.total_time;
+            double efficiency = speedup / size;
+            double speedup_ideal = size;
+            
+            cout << "\nRendimiento:\n";
+            cout << "  Ts (secuencial):   " << (Ts * 1000) << " ms\n";
+            cout << "  Speedup (S):       " << speedup << "x\n";
+            cout << "  Eficiencia (E):    " << (efficiency * 100) << "%\n\n";
+            
+            cout << "  Speedup ideal:     " << speedup_ideal << "x\n";
+            cout << "  % del ideal:       " << (speedup/speedup_ideal*100) << "%\n";
+        }
+        
+        // FLOPs
+        long long flops = (engine == Engine::HISTOGRAM)
+            ? calculate_flops_histogram(grid, value_range)
+            : calculate_flops(grid);
+        double flops_per_sec = flops / m.compute_time;  // Usar solo tiempo de cómputo
+        double gflops = flops_per_sec / 1e9;
+        double mflops = flops_per_sec / 1e6;
+        
+        cout << "\nFLOPs:\n";
+        cout << "  Operaciones:       " << flops << "\n";
+        cout << "  FLOP/s:            " << flops_per_sec << "\n";
+        cout << "  MFLOP/s:           " << mflops << "\n";
+        cout << "  GFLOP/s:           " << gflops << "\n";
+        
+        // Throughput
+        double throughput = N / m.total_time;
+        cout << "\nThroughput:\n";
+        cout << "  Elementos/seg:     " << throughput << "\n";
+        
+        // Balance
+        if (m.comm_time > 0) {
+            cout << "\nBalance:\n";
+            cout << "  Cómputo/Comm:      " << (m.compute_time/m.comm_time) << "x\n";
+        }
+        
+        cout << string(70, '=') << "\n";
+        
+        // CSV para análisis
+        cout << "\nFORMATO CSV:\n";
+        cout << "P,N,rows,cols,Tp_ms,compute_ms,comm_ms,";
+        if (Ts > 0) cout << "Ts_ms,speedup,efficiency,";
+        cout << "flops,gflops,throughput";
+        if (!per_rank.empty()) {
+            for (const TimedPhase& phase : TIMED_PHASES) {
+                cout << "," << phase.csv_name << "_min_ms," << phase.csv_name << "_mean_ms,"
+                     << phase.csv_name << "_max_ms," << phase.csv_name << "_imbalance";
+            }
+        }
+        if (counters) {
+            for (int p = 0; p < COUNTED_PHASES; p++) {
+                for (int c = 0; c < PERF_COUNTERS; c++) {
+                    cout << "," << TIMED_PHASES[p].csv_name << "_" << PERF_COUNTER_INFO[c].csv_name;
+                }
+            }
+        }
+        cout << "\n";
+        
+        cout << size << "," << N << "," << grid.rows << "," << grid.cols << ","
+             << (m.total_time*1000) << ","
+             << (m.compute_time*1000) << ","
+             << (m.comm_time*1000) << ",";
+        
+        if (Ts > 0) {
+            cout << (Ts*1000) << ","
+                 << (Ts/m.total_time) << ","
+                 << ((Ts/m.total_time)/size) << ",";
+        }
+        
+        cout << flops << ","
+             << gflops << ","
+             << throughput;
+        if (!per_rank.empty()) {
+            for (const TimedPhase& phase : TIMED_PHASES) {
+                PhaseStats stats = phase_stats(per_rank, phase.field);
+                cout << "," << (stats.min * 1000) << "," << (stats.mean * 1000) << ","
+                     << (stats.max * 1000) << "," << stats.imbalance();
+            }
+        }
+        if (counters) {
+            // Contadores sin origen quedan vacíos
+            cout << setprecision(0);
+            for (int p = 0; p < COUNTED_PHASES; p++) {
+                for (int c = 0; c < PERF_COUNTERS; c++) {
+                    cout << ",";
+                    if (counters->sources[c] != CounterSource::NONE) cout << counters->values[p][c];
+                }
+            }
+            cout << setprecision(3);
+        }
+        cout << "\n";
+    }
+}
+
+// ===== IMPRESIÓN DE RESULTADOS POR PROCESO =====
+// Las claves se imprimen con + para que char salga como número
+template <typename Key, typename Rank>
+void print_process_data(
+    int rank, const Grid& grid,
+    const vector<Key>& original,
+    const vector<Key>& sorted_local,
+    const vector<Key>& broadcasted,
+    const vector<int>& local_ranking,
+    const vector<Rank>& reduced_ranking,
+    const vector<Key>& sorted_slice = {},
+    bool scattered = false
+) {
+    auto [row, col] = rank_to_position(rank, grid);
+    bool is_root = is_row_root(rank, grid);
+    
+    cout << "\n" << string(70, '-') << "\n";
+    cout << "Proceso " << rank << " (fila=" << row << ", col=" << col << ")";
+    if (is_root) cout << (grid.square() ? " [DIAGONAL]" : " [RAÍZ DE FILA]");
+    cout << "\n" << string(70, '-') << "\n";
+    
+    int show = min(12, (int)original.size());
+    
+    cout << "Original:       [";
+    for (int i = 0; i < show; i++) {
+        cout << setw(4) << +original[i];
+        if (i < show - 1) cout << ",";
+    }
+    if (original.size() > (size_t)show) cout << ", ...";
+    cout << "]\n";
+    
+    // El motor histograma no ordena ni hace broadcast: esos arreglos quedan vacíos
+    if (!sorted_local.empty()) {
+        int shown = min(12, (int)sorted_local.size());
+        cout << "Sorted:         [";
+        for (int i = 0; i < shown; i++) {
+            cout << setw(4) << +sorted_local[i];
+            if (i < shown - 1) cout << ",";
+        }
+        if (sorted_local.size() > (size_t)shown) cout << ", ...";
+        cout << "]\n";
+    }
+    
+    if (!broadcasted.empty()) {
+        int shown = min(12, (int)broadcasted.size());
+        cout << "Broadcasted:    [";
+        for (int i = 0; i < shown; i++) {
+            cout << setw(4) << +broadcasted[i];
+            if (i < shown - 1) cout << ",";
+        }
+        if (broadcasted.size() > (size_t)shown) cout << ", ...";
+        cout << "]\n";
+    }
+    
+    if (!local_ranking.empty()) {
+        int shown = min(12, (int)local_ranking.size());
+        cout << "Local Ranking:  [";
+        for (int i = 0; i < shown; i++) {
+            cout << setw(4) << local_ranking[i];
+            if (i < shown - 1) cout << ",";
+        }
+        if (local_ranking.size() > (size_t)shown) cout << ", ...";
+        cout << "]\n";
+    }
+    
+    // Ranking global: en la raíz de la fila, en cada proceso con reduce-scatter o,
+    // en el motor histograma, en los procesos con grupos propios
+    if (!reduced_ranking.empty()) {
+        int shown = min(12, (int)reduced_ranking.size());
+        cout << "Global Ranking: [";
+        for (int i = 0; i < shown; i++) {
+            cout << setw(4) << reduced_ranking[i];
+            if (i < shown - 1) cout << ",";
+        }
+        if (reduced_ranking.size() > (size_t)shown) cout << ", ...";
+        cout << "]";
+        if (scattered) {
+            int start = block_part_begin(broadcasted.size(), col, grid.cols);
+            cout << " (broadcast[" << start << ".." << (start + (int)reduced_ranking.size() - 1) << "])";
+        }
+        cout << "\n";
+    }
+    
+    // Tramo del arreglo ordenado que quedó en este proceso (fase 6)
+    if (!sorted_slice.empty()) {
+        int shown = min(12, (int)sorted_slice.size());
+        cout << "Sorted Output:  [";
+        for (int i = 0; i < shown; i++) {
+            cout << setw(4) << +sorted_slice[i];
+            if (i < shown - 1) cout << ",";
+        }
+        if (sorted_slice.size() > (size_t)shown) cout << ", ...";
+        cout << "]\n";
+    }
+}
+
+// ===== EJECUCIÓN =====
+// Parámetros de una corrida, ya validados en main. [min, max], el motor y
+// scattered dependen del tipo de clave y los completa run_with_key.
+struct RunConfig {
+    MPI_Comm comm;  // procesos de la malla (MPI_COMM_WORLD salvo en ranking_bench)
+    Grid grid;
+    double Ts;
+    bool verbose, show_results;
+    RankingKernel ranking_kernel;
+    Engine engine;
+    SortBackend sort_backend;
+    Distribution dist;  // forma de los datos generados (--dist; sin --input)
+    int threads;
+    string input_path, output_path;
+    bool sorted_output;
+    int pipeline_segments;
+    bool scattered;
+    bool compress;
+    bool barriers;  // false con --no-barriers
+    bool verify;    // --verify
+    PerfCounters* counters;  // --counters (nullptr si no)
+    bool quiet;              // sin métricas ni resultados (ranking_bench)
+};
+
+// Fases 1-6 y salida con claves de tipo Key y rankings globales de tipo Rank
+// (ver rank_mpi_type). result, si no es nulo, recibe las Metrics reportadas
+// (en rank 0, las de la malla). service (--serve): la entrada es el lote de
+// rank 0 y los rankings propios quedan en service->ranking
+template <typename Key, typename Rank>
+int run_ranking(const RunConfig& config, Key min_val, Key max_val, int rank, MPI_Comm row_comm,
+                ThreadPool* pool, Metrics* result = nullptr, ServiceBuffers<Key>* service = nullptr) {
+    MPI_Comm comm = config.comm;
+    const Grid& grid = config.grid;
+    long long N = grid.N;
+    int size = grid.size();
+    double Ts = config.Ts;
+    bool verbose = config.verbose, show_results = config.show_results;
+    RankingKernel ranking_kernel = config.ranking_kernel;
+    Engine engine = config.engine;
+    SortBackend sort_backend = config.sort_backend;
+    int threads = config.threads;
+    const string& input_path = config.input_path;
+    const string& output_path = config.output_path;
+    bool sorted_output = config.sorted_output;
+    int pipeline_segments = config.pipeline_segments;
+    bool scattered = config.scattered;
+    bool compress = config.compress;
+    
+    // Con barreras (por defecto) cada fase empieza y termina a la vez en todos
+    // los procesos y los tiempos de rank 0 valen para la malla; con
+    // --no-barriers cada proceso mide solo lo suyo (ver gather_metrics)
+    // Con --counters, el tiempo en la barrera no se cuenta en la fase en curso
+    PerfCounters* counters = config.counters;
+    double counter_start[PERF_COUNTERS];
+    auto sync = [&] {
+        if (!config.barriers) return;
+        TraceScope scope("MPI_Barrier", "sync");
+        double before[PERF_COUNTERS], after[PERF_COUNTERS];
+        if (counters) counters->read(before);
+        MPI_Barrier(comm);
+        if (counters) {
+            counters->read(after);
+            for (int c = 0; c < PERF_COUNTERS; c++) counter_start[c] += after[c] - before[c];
+        }
+    };
+    
+    auto thread_utilization = [&](double phase_start) {
+        if (!pool) return 0.0;
+        return pool->busy_time() / ((MPI_Wtime() - phase_start) * threads);
+    };
+    
+    // Inicializar métricas
+    Metrics metrics = {0};
+    double t_start;
+    
+    PhaseCounters phase_counters = {};
+    if (counters) {
+        for (int c = 0; c < PERF_COUNTERS; c++) phase_counters.sources[c] = counters->source(c);
+    }
+    
+    // Abre una fase: t_start y, con --counters, la lectura inicial (antes del
+    // reloj, para que no entre en el tiempo de la fase)
+    auto phase_start = [&] {
+        if (counters) counters->read(counter_start);
+        t_start = MPI_Wtime();
+    };
+    
+    // Cierra la fase que empezó en t_start: devuelve su duración, la deja en
+    // la traza (--trace) y suma sus contadores en slot (si es una CountedPhase)
+    auto phase_done = [&](const char* name, int slot = COUNTED_PHASES) {
+        double now = MPI_Wtime();
+        trace().add(name, "fase", t_start, now);
+        if (counters && slot < COUNTED_PHASES) {
+            double values[PERF_COUNTERS];
+            counters->read(values);
+            for (int c = 0; c < PERF_COUNTERS; c++) {
+                phase_counters.values[slot][c] += values[c] - counter_start[c];
+            }
+        }
+        return now - t_start;
+    };
+    
+    // ===== EJECUCIÓN DEL ALGORITMO =====
+    MPI_Barrier(comm);  // todos arrancan juntos, también sin barreras
+    double total_start = MPI_Wtime();
+    
+    // FASE 1: Input + Gossip
+    sync();
+    phase_start();
+    vector<Key> local_data;
+    vector<Key> row_block;  // bloque de la fila en su raíz (solo malla rectangular)
+    bool with_row_block = (engine == Engine::SORT);
+    if (service) {
+        phase1_input_batch(*service, grid, rank, with_row_block, local_data, row_block, row_comm, comm);
+    } else if (input_path.empty()) {
+        local_data = phase1_input_gossip(grid, min_val, max_val, rank, config.dist);
+        if (with_row_block) row_block = phase1_row_block(grid, min_val, max_val, rank, config.dist);
+    } else if (!phase1_input_file(input_path, grid, rank, with_row_block, local_data, row_block, comm)) {
+        return 1;
+    } else {
+        // Cada bloque de columna lo leen sus rows procesos; los bloques de fila, una vez
+        int reads = grid.rows + (with_row_block && !grid.square() ? 1 : 0);
+        metrics.input_bytes = (double)N * sizeof(Key) * reads;
+    }
+    vector<Key> original_data = local_data;  // Guardar copia para -r
+    
+    // Kernels auto: cada proceso elige con una muestra de su bloque (puede
+    // elegir distinto que sus vecinos)
+    KernelChoice choice = {DataShape::RANDOM, sort_backend, ranking_kernel};
+    bool adaptive = engine == Engine::SORT &&
+                    (sort_backend == SortBackend::AUTO || ranking_kernel == RankingKernel::AUTO);
+    if (adaptive) {
+        TraceScope scope("Selección de kernels", "fase");
+        choice = choose_kernels(local_data, sort_backend, ranking_kernel);
+        sort_backend = choice.sort;
+        ranking_kernel = choice.ranking;
+    }
+    sync();
+    metrics.phase1_time = phase_done("Fase 1 (Input)", CP_INPUT);
+    
+    // El motor histograma indexa por v - min: los datos leídos deben estar en rango
+    if (engine == Engine::HISTOGRAM && !input_path.empty()) {
+        int local_bad = 0, any_bad = 0;
+        for (Key value : local_data) {
+            if (value < min_val || value > max_val) local_bad = 1;
+        }
+        TraceScope scope("MPI_Allreduce (rango)", "colectiva");
+        MPI_Allreduce(&local_bad, &any_bad, 1, MPI_INT, MPI_MAX, comm);
+        if (any_bad) {
+            if (rank == 0) cerr << "ERROR: " << input_path << " tiene valores fuera de [min, max]\n";
+            return 1;
+        }
+    }
+    
+    vector<Key> broadcasted_data;
+    vector<int> local_ranking;
+    vector<Rank> reduced_ranking;
+    double bcast_bytes[2] = {0, 0};   // {sin comprimir, en la red} de este proceso
+    double reduce_bytes[2] = {0, 0};
+    
+    if (engine == Engine::HISTOGRAM) {
+        if constexpr (is_integral_v<Key>) {  // con claves reales el motor es siempre sort
+            // FASE 3: Histograma local (sin broadcast ni sort)
+            sync();
+            phase_start();
+            vector<Rank> histogram = phase3_histogram<Rank>(local_data, min_val, max_val);
+            sync();
+            metrics.phase3_time = phase_done("Fase 3 (Histograma)", CP_SORT);
+            
+            // FASE 5: Allreduce del histograma en la fila (+ Exscan para el desempate)
+            sync();
+            phase_start();
+            vector<Rank> global_hist = phase5_histogram_allreduce(histogram, row_comm);
+            vector<Rank> before_hist;
+            if (sorted_output) before_hist = phase5_histogram_exscan(histogram, rank, grid, row_comm);
+            sync();
+            metrics.phase5_time = phase_done("Fase 5 (Allreduce)", CP_REDUCE);
+            
+            // FASE 4: Suma prefija + ranking O(1) (o destino único) de los grupos propios
+            sync();
+            phase_start();
+            reduced_ranking = sorted_output
+                ? phase4_histogram_destinations(local_data, global_hist, before_hist, min_val, rank, grid)
+                : phase4_histogram_lookup(local_data, global_hist, min_val, rank, grid);
+            sync();
+            metrics.phase4_time = phase_done("Fase 4 (Lookup)", CP_RANKING);
+        }
+    } else if (pipeline_segments > 0) {
+        // FASES 2-5 solapadas, sin barreras intermedias
+        sync();
+        phase_start();
+        EytzingerIndex<Key> search_index;
+        pipelined_phases(local_data, row_block, broadcasted_data, local_ranking, reduced_ranking,
+                         pipeline_segments, ranking_kernel, sort_backend, sorted_output, scattered,
+                         rank, grid, row_comm, pool, search_index, metrics);
+        sync();
+        phase_done("Fases 2-5 (Pipeline)", CP_PIPELINE);
+        
+        // Cada proceso midió lo suyo: se reporta el peor caso (con --no-barriers
+        // lo hace gather_metrics al final)
+        if (config.barriers) {
+            double local_times[] = {metrics.phase2_time, metrics.phase3_time, metrics.index_time,
+                                    metrics.phase4_time, metrics.phase5_time, metrics.pipeline_time,
+                                    metrics.pipeline_inflight};
+            double max_times[7];
+            TraceScope scope("MPI_Reduce (tiempos)", "métricas");
+            MPI_Reduce(local_times, max_times, 7, MPI_DOUBLE, MPI_MAX, 0, comm);
+            metrics.phase2_time = max_times[0];
+            metrics.phase3_time = max_times[1];
+            metrics.index_time = max_times[2];
+            metrics.phase4_time = max_times[3];
+            metrics.phase5_time = max_times[4];
+            metrics.pipeline_time = max_times[5];
+            metrics.pipeline_inflight = max_times[6];
+        }
+    } else {
+        // FASE 2: Broadcast (empaquetado con --compress)
+        sync();
+        phase_start();
+        broadcasted_data = compress
+            ? phase2_broadcast_packed(local_data, row_block, rank, grid, row_comm, bcast_bytes)
+            : phase2_broadcast(local_data, row_block, rank, grid, row_comm);
+        sync();
+        metrics.phase2_time = phase_done("Fase 2 (Broadcast)", CP_BCAST);
+        
+        // FASE 3: Sort
+        sync();
+        phase_start();
+        if (pool) pool->reset_stats();
+        phase3_sort(local_data, sort_backend, pool);
+        metrics.phase3_util = thread_utilization(t_start);
+        sync();
+        metrics.phase3_time = phase_done("Fase 3 (Sort)", CP_SORT);
+        
+        // FASE 3b: Índice de búsqueda (solo kernel index). Con --ranking auto
+        // todos pasan por las barreras aunque no construyan el índice
+        EytzingerIndex<Key> search_index;
+        if (ranking_kernel == RankingKernel::INDEX || config.ranking_kernel == RankingKernel::AUTO) {
+            sync();
+            phase_start();
+            if (ranking_kernel == RankingKernel::INDEX) search_index.build(local_data);
+            sync();
+            metrics.index_time = phase_done("Fase 3b (Índice)", CP_INDEX);
+        }
+        
+        // FASE 4: Ranking
+        sync();
+        phase_start();
+        if (pool) pool->reset_stats();
+        if (sorted_output) {
+            vector<KeyedEntry<Key>> own_keys = tiebreak_own_keys(original_data, rank, grid, pool);
+            local_ranking = phase4_local_ranking_tiebreak(ranking_kernel, local_data, search_index,
+                                                          own_keys, broadcasted_data, rank, grid, pool);
+        } else {
+            local_ranking = phase4_rank(ranking_kernel, local_data, search_index, broadcasted_data, pool);
+        }
+        metrics.phase4_util = thread_utilization(t_start);
+        sync();
+        metrics.phase4_time = phase_done("Fase 4 (Ranking)", CP_RANKING);
+        
+        // FASE 5: Reduce (o reduce-scatter en la fila)
+        sync();
+        phase_start();
+        if (compress) {
+            reduced_ranking = phase5_reduce_packed<Rank>(local_ranking, scattered, rank, grid, row_comm,
+                                                         reduce_bytes);
+        } else {
+            reduced_ranking = scattered
+                ? phase5_reduce_scatter<Rank>(local_ranking, rank, grid, row_comm)
+                : phase5_reduce<Rank>(local_ranking, rank, grid, row_comm);
+        }
+        sync();
+        metrics.phase5_time = phase_done("Fase 5 (Reduce)", CP_REDUCE);
+    }
+    
+    // FASE 6: Redistribución al orden global (el tramo r de la malla queda en el proceso r)
+    vector<Key> sorted_slice;
+    if (sorted_output) {
+        sync();
+        phase_start();
+        double bytes_sent = 0;
+        vector<Key> values = owned_ranking_values(engine, scattered, original_data, broadcasted_data, rank, grid);
+        sorted_slice = phase6_redistribute(values, reduced_ranking, grid, rank, bytes_sent, comm);
+        sync();
+        metrics.phase6_time = phase_done("Fase 6 (Redistribución)", CP_REDISTRIBUTE);
+        TraceScope scope("MPI_Reduce (bytes)", "métricas");
+        MPI_Reduce(&bytes_sent, &metrics.phase6_bytes, 1, MPI_DOUBLE, MPI_SUM, 0, comm);
+    }
+    
+    // Tiempo total
+    sync();
+    metrics.total_time = MPI_Wtime() - total_start;
+    trace().add("Total", "fase", total_start, total_start + metrics.total_time);
+    
+    // Calcular tiempos agregados
+    metrics.compute_time = metrics.phase3_time + metrics.index_time + metrics.phase4_time;
+    metrics.comm_time = metrics.phase2_time + metrics.phase5_time + metrics.phase6_time;
+    
+    // Bytes de las fases 2 y 5 sumados en todos los procesos (sin --compress,
+    // lo que viaja es el bloque y el ranking parcial tal cual)
+    if (engine == Engine::SORT) {
+        if (!compress) {
+            if (is_row_root(rank, grid)) {
+                bcast_bytes[0] = bcast_bytes[1] = (double)broadcasted_data.size() * sizeof(Key);
+            }
+            reduce_bytes[0] = reduce_bytes[1] = (double)local_ranking.size() * sizeof(Rank);
+        }
+        double local_bytes[] = {bcast_bytes[0], bcast_bytes[1], reduce_bytes[0], reduce_bytes[1]};
+        double total_bytes[4];
+        TraceScope scope("MPI_Reduce (bytes)", "métricas");
+        MPI_Reduce(local_bytes, total_bytes, 4, MPI_DOUBLE, MPI_SUM, 0, comm);
+        metrics.phase2_bytes = total_bytes[0];
+        metrics.phase2_wire_bytes = total_bytes[1];
+        metrics.phase5_bytes = total_bytes[2];
+        metrics.phase5_wire_bytes = total_bytes[3];
+    }
+    
+    if (counters) phase_counters = reduce_counters(phase_counters, comm);
+    
+    // Verificación distribuida (fuera de Tp), contra el generador si no hay --input
+    VerifyReport verify_report = {};
+    if (config.verify) {
+        function<Key(long long)> regenerate;
+        if (input_path.empty() && !service) {
+            regenerate = [&](long long pos) {
+                Key value;
+                distribution_fill(&value, (uint64_t)pos, 1, (uint64_t)N, min_val, max_val, 42, config.dist);
+                return value;
+            };
+        }
+        verify_report = verify_ranking(
+            owned_ranking_values(engine, scattered, original_data, broadcasted_data, rank, grid),
+            reduced_ranking, owned_ranking_segments(engine, scattered, rank, grid), original_data,
+            sorted_slice, sorted_output, regenerate, rank, grid, comm);
+        if (!verify_report.ok() && rank == 0 && config.quiet) {
+            cerr << "ERROR: la verificación del ranking falló\n";
+        }
+    }
+    
+    vector<KernelChoice> choices;
+    if (adaptive) choices = gather_kernel_choices(choice, rank, size, comm);
+    
+    // Sin barreras: una sola recolección al final; rank 0 reporta el peor caso
+    // de cada fase (el total es el del proceso más lento)
+    vector<Metrics> per_rank;
+    if (!config.barriers) {
+        per_rank = gather_metrics(metrics, rank, size, comm);
+        for (const TimedPhase& phase : TIMED_PHASES) {
+            if (rank == 0) metrics.*phase.field = phase_stats(per_rank, phase.field).max;
+        }
+    }
+    
+    // Escritura del arreglo ordenado (fuera de Tp, como la carga en secuencial)
+    if (!output_path.empty()) {
+        MPI_Barrier(comm);
+        phase_start();
+        bool written = write_sorted_output(output_path, sorted_slice, grid, rank, comm);
+        MPI_Barrier(comm);
+        metrics.output_time = phase_done("Salida (MPI-IO)");
+        if (!written) {
+            return 1;
+        }
+    }
+    
+    // Servicio: rankings propios para la respuesta; los bloques vuelven a los buffers
+    if (service) {
+        service->ranking.assign(reduced_ranking.begin(), reduced_ranking.end());
+        service->engine = engine;
+        service->scattered = scattered;
+        service->column_block = move(local_data);
+        service->row_block = move(row_block);
+    }
+    
+    if (result) *result = metrics;
+    if (config.quiet) return (config.verify && !verify_report.ok()) ? 1 : 0;
+    
+    // ===== SALIDA =====
+    long long value_range = (engine == Engine::HISTOGRAM) ? (long long)max_val - (long long)min_val + 1 : 0;
+    print_metrics(rank, grid, metrics, Ts, verbose, config.ranking_kernel, engine, value_range,
+                  config.sort_backend, threads, scattered, 8 * sizeof(Rank), KeyTraits<Key>::name,
+                  sizeof(Key), per_rank, counters ? &phase_counters : nullptr, choices);
+    if (config.verify) print_verification(rank, verify_report);
+    
+    if (show_results) {
+        for (int i = 0; i < size; i++) {
+            if (rank == i) {
+                const vector<Key> no_sorted;
+                print_process_data(rank, grid, original_data,
+                                  engine == Engine::HISTOGRAM ? no_sorted : local_data,
+                                  broadcasted_data, local_ranking, reduced_ranking, sorted_slice,
+                                  scattered);
+            }
+            MPI_Barrier(comm);
+        }
+    }
+    
+    return (config.verify && !verify_report.ok()) ? 1 : 0;
+}
+
+// Con [min, max] ya interpretado (y válido para el motor): elige el motor y el
+// tipo del ranking, int mientras N quepa, int64_t si no. El modo servicio
+// entra por acá con el rango de cada lote
+template <typename Key>
+int run_with_range(RunConfig config, const string& engine_arg, Key min_val, Key max_val, int rank,
+                   MPI_Comm row_comm, ThreadPool* pool, Metrics* result = nullptr,
+                   ServiceBuffers<Key>* service = nullptr) {
+    const Grid& grid = config.grid;
+    
+    // Motor: histogram si se pide o si (auto) el rango cabe en caché
+    config.engine = Engine::SORT;
+    if (engine_arg == "histogram" ||
+        (engine_arg == "auto" && histogram_engine_fits(min_val, max_val, grid.N / grid.cols))) {
+        config.engine = Engine::HISTOGRAM;
+    }
+    
+    // El motor histograma no tiene reduce de rankings: --scatter no aplica
+    config.scattered = config.scattered && config.engine == Engine::SORT;
+    
+    // Rankings globales en int mientras N quepa; int64_t solo si hace falta
+    return (grid.N <= INT_MAX)
+        ? run_ranking<Key, int>(config, min_val, max_val, rank, row_comm, pool, result, service)
+        : run_ranking<Key, int64_t>(config, min_val, max_val, rank, row_comm, pool, result, service);
+}
+
+// ===== VENTANA DESLIZANTE (--window) =====
+// Ranking incremental: la ventana son las N claves más recientes de un flujo
+// (stream_fill; las primeras N son las de la fase 1). En cada paso llegan B
+// claves, vencen las B más viejas y se piden los rankings (# <= v en la
+// ventana) de las que llegaron, sin recalcular las N.
+// Misma partición que la malla: cada proceso de la columna j guarda su bloque
+// en un OrderStatTree (order_stat_tree.h) y una cola en orden de llegada. Las
+// claves iniciales siguen en sus grupos, las nuevas van a la columna pos mod
+// cols y cada columna vence las suyas desde el frente de la cola. El ranking
+// de una clave es la suma de los conteos de todas las columnas: la fila i
+// atiende las consultas k ≡ i (mod rows) y las suma en su raíz con un reduce,
+// como la fase 5. Por paso cada proceso hace O((B/cols + B/rows) log N)
+// contra las fases 1-5 sobre bloques de N/cols; se compara con el Tp de una
+// corrida completa con la misma N.
+
+// Columna que guarda la posición pos del flujo
+inline int window_column(long long pos, const Grid& grid) {
+    return (pos < grid.N ? grid.group_of(pos) : pos) % grid.cols;
+}
+
+// Percentil q de valores ordenados (rango más cercano)
+double percentile(const vector<double>& sorted_values, double q) {
+    if (sorted_values.empty()) return 0;
+    size_t k = static_cast<size_t>(ceil(q * sorted_values.size()));
+    return sorted_values[max<size_t>(k, 1) - 1];
+}
+
+template <typename Key>
+int run_window(const RunConfig& config, const string& engine_arg, Key min_val, Key max_val,
+               int steps, int batch, int rank, MPI_Comm row_comm, ThreadPool* pool) {
+    MPI_Comm comm = config.comm;
+    const Grid& grid = config.grid;
+    long long N = grid.N;
+    auto [row, col] = rank_to_position(rank, grid);
+    int root = grid.row_root(row);
+    
+    // Recalcular todo: fases 1-5 completas con la misma N y las mismas opciones
+    RunConfig full_config = config;
+    full_config.quiet = true;
+    full_config.verify = false;
+    Metrics full = {};
+    if (run_with_range<Key>(full_config, engine_arg, min_val, max_val, rank, row_comm, pool, &full) != 0) {
+        return 1;
+    }
+    Engine full_engine = (engine_arg == "histogram" ||
+                          (engine_arg == "auto" && histogram_engine_fits(min_val, max_val, N / grid.cols)))
+        ? Engine::HISTOGRAM : Engine::SORT;
+    
+    // Ventana inicial: el bloque de la columna (fase 1) en el árbol y en la cola
+    MPI_Barrier(comm);
+    double build_start = MPI_Wtime();
+    vector<Key> column = phase1_input_gossip(grid, min_val, max_val, rank, config.dist);
+    deque<Key> arrival_order(column.begin(), column.end());
+    sort(column.begin(), column.end());
+    OrderStatTree<Key> tree;
+    tree.build(column);
+    vector<Key>().swap(column);
+    MPI_Barrier(comm);
+    double build_time = MPI_Wtime() - build_start;
+    
+    vector<Key> arrivals(batch);
+    vector<int64_t> partial, counts;
+    vector<double> update_times, query_times, step_times;
+    long long missing = 0;  // vencidas que el árbol no tenía (debe quedar en 0)
+    
+    for (int s = 0; s < steps; s++) {
+        long long first_new = N + (long long)s * batch, first_old = (long long)s * batch;
+        stream_fill(arrivals.data(), first_new, batch, N, min_val, max_val, 42, config.dist);
+        
+        // Actualización: las que llegan a esta columna y las que vencen de ella
+        if (config.barriers) MPI_Barrier(comm);
+        double start = MPI_Wtime();
+        for (int k = 0; k < batch; k++) {
+            if ((first_new + k) % grid.cols != col) continue;
+            tree.insert(arrivals[k]);
+            arrival_order.push_back(arrivals[k]);
+        }
+        for (long long pos = first_old; pos < first_old + batch; pos++) {
+            if (window_column(pos, grid) != col) continue;
+            missing += !tree.erase(arrival_order.front());
+            arrival_order.pop_front();
+        }
+        if (config.barriers) MPI_Barrier(comm);
+        double updated = MPI_Wtime();
+        
+        // Consultas de la fila: conteo en la columna propia, suma en la raíz
+        partial.clear();
+        for (int k = row; k < batch; k += grid.rows) partial.push_back(tree.count_le(arrivals[k]));
+        counts.resize(partial.size());
+        MPI_Reduce(partial.data(), counts.data(), partial.size(), MPI_INT64_T, MPI_SUM, root, row_comm);
+        if (config.barriers) MPI_Barrier(comm);
+        double end = MPI_Wtime();
+        
+        update_times.push_back(updated - start);
+        query_times.push_back(end - updated);
+        step_times.push_back(end - start);
+    }
+    
+    // --verify: rankings del último paso contra la cola ordenada (búsqueda
+    // binaria), árbol y cola del mismo tamaño y la ventana con N claves
+    long long mismatches = 0;
+    bool verified = false;
+    if (config.verify) {
+        vector<Key> window(arrival_order.begin(), arrival_order.end());
+        sort(window.begin(), window.end());
+        vector<int64_t> expected_partial, expected(partial.size());
+        for (int k = row; k < batch; k += grid.rows) {
+            expected_partial.push_back(upper_bound(window.begin(), window.end(), arrivals[k]) - window.begin());
+        }
+        MPI_Reduce(expected_partial.data(), expected.data(), expected_partial.size(), MPI_INT64_T, MPI_SUM,
+                   root, row_comm);
+        if (col == root) {
+            for (size_t k = 0; k < counts.size(); k++) mismatches += counts[k] != expected[k];
+        }
+        mismatches += missing + (tree.size() != (int64_t)arrival_order.size());
+        long long row_window = arrival_order.size(), window_size = 0;
+        MPI_Allreduce(&row_window, &window_size, 1, MPI_LONG_LONG, MPI_SUM, row_comm);
+        mismatches += window_size != N;
+        long long local_mismatches = mismatches;
+        MPI_Reduce(&local_mismatches, &mismatches, 1, MPI_LONG_LONG, MPI_SUM, 0, comm);
+        verified = true;
+    }
+    
+    if (rank != 0 || config.quiet) return (rank == 0 && mismatches > 0) ? 1 : 0;
+    
+    double step_total = 0;
+    for (double t : step_times) step_total += t;
+    double step_mean = step_total / steps;
+    sort(update_times.begin(), update_times.end());
+    sort(query_times.begin(), query_times.end());
+    
+    cout << fixed << setprecision(6);
+    cout << "\n" << string(70, '=') << "\n";
+    cout << "VENTANA DESLIZANTE - MÉTRICAS\n";
+    cout << string(70, '=') << "\n";
+    cout << "Ventana:           " << N << " claves " << KeyTraits<Key>::name << " (malla " << grid.rows
+         << "x" << grid.cols << ", " << distribution_name(config.dist) << ")\n";
+    cout << "Pasos:             " << steps << " × " << batch << " claves (llegan y vencen)\n";
+    cout << "Árbol (rank 0):    " << tree.size() << " claves, altura " << tree.height() << ", carga "
+         << build_time * 1000 << " ms\n";
+    cout << "Actualizar (ms):   p50 " << percentile(update_times, 0.50) * 1000 << " | p90 "
+         << percentile(update_times, 0.90) * 1000 << " | máx " << update_times.back() * 1000 << "\n";
+    cout << "Consultar (ms):    p50 " << percentile(query_times, 0.50) * 1000 << " | p90 "
+         << percentile(query_times, 0.90) * 1000 << " | máx " << query_times.back() * 1000 << "\n";
+    cout << "Paso (media):      " << step_mean * 1000 << " ms (" << batch / step_mean / 1e6
+         << " M rankings/s)\n";
+    cout << "Recalcular todo:   " << full.total_time * 1000 << " ms (Tp, fases 1-5, motor "
+         << engine_name(full_engine) << ")\n";
+    cout << "Speedup por paso:  " << full.total_time / step_mean << "x\n";
+    if (!config.barriers) cout << "(sin barreras: tiempos de rank 0)\n";
+    if (verified) {
+        cout << "Verificación:      " << (mismatches == 0 ? "OK" : "FALLÓ") << " (último paso: " << batch
+             << " rankings contra la ventana ordenada)\n";
+    }
+    cout << string(70, '=') << "\n";
+    return mismatches > 0 ? 1 : 0;
+}
+
+// ===== SELECCIÓN DISTRIBUIDA (--select) =====
+// La k-ésima menor (mediana, p99, umbral del top-k) sin el ranking completo.
+// Fases 1 y 3 como siempre: cada columna ordena su bloque. El bloque ordenado
+// se parte en rows tramos contiguos y el proceso (i, j) se queda con el i: los
+// P tramos son subconjuntos ordenados y disjuntos de las N claves. Cada
+// objetivo k tiene en cada proceso un tramo [lo, hi) de candidatas y su
+// posición r entre las candidatas de todos. Por ronda, para todos los
+// objetivos a la vez:
+//   MPI_Allgather   candidatas por proceso (q enteros por proceso)
+//   MPI_Allgatherv  hasta SELECT_SAMPLES muestras equiespaciadas por proceso
+//                   y objetivo; si quedan <= P·SELECT_SAMPLES candidatas van
+//                   todas y la respuesta sale de ellas (última ronda)
+//   MPI_Allreduce   # < s y # <= s de cada muestra s: la respuesta es la
+//                   muestra con # < s <= r < # <= s, o queda entre dos
+//                   muestras consecutivas y el tramo se achica a ese hueco
+// Cada ronda divide las candidatas por ~SELECT_SAMPLES: O(log_S(N/P))
+// rondas con mensajes de O(q·P·S) claves, contra las N claves que mueven las
+// fases 2 y 5.
+const int SELECT_SAMPLES = 32;
+
+// Objetivos de --select: posiciones k (1..N) y cómo se pidieron
+struct SelectTargets {
+    vector<long long> ranks;
+    vector<string> labels;
+};
+
+// LISTA separada por comas: q en [0, 1] (cuantil: k = ⌈q·N⌉), pQ (percentil
+// Q), top:K (umbral de las K mayores: k = N - K + 1) o k entero en [1, N]
+bool parse_select(const string& list, long long N, SelectTargets& targets) {
+    size_t begin = 0;
+    while (begin <= list.size()) {
+        size_t end = list.find(',', begin);
+        if (end == string::npos) end = list.size();
+        string item = list.substr(begin, end - begin);
+        begin = end + 1;
+        
+        // number: donde empieza el número tras el prefijo ("top:", "p")
+        const char* number = item.c_str();
+        char* rest = nullptr;
+        long long k = 0;
+        if (item.rfind("top:", 0) == 0) {
+            number += 4;
+            long long top = strtoll(number, &rest, 10);
+            k = N - top + 1;
+        } else if (item[0] == 'p' || item.find('.') != string::npos) {
+            number += (item[0] == 'p');
+            double q = strtod(number, &rest);
+            if (item[0] == 'p') q /= 100;
+            if (!(q >= 0 && q <= 1)) return false;
+            k = max(1LL, (long long)ceil(q * N));
+        } else {
+            k = strtoll(number, &rest, 10);
+        }
+        if (rest == number || *rest != '\0' || k < 1 || k > N) return false;
+        targets.ranks.push_back(k);
+        targets.labels.push_back(item);
+    }
+    return true;
+}
+
+// Claves y bytes de las colectivas de selección (aportes de todos los procesos)
+struct SelectStats {
+    int rounds;
+    double bytes;
+};
+
+// k-ésimas (0-based) de la unión de los tramos ordenados data[0..n) de los
+// procesos de comm; todos reciben todas las respuestas
+template <typename Key>
+vector<Key> distributed_select(const Key* data, int n, const vector<long long>& targets, MPI_Comm comm,
+                               SelectStats& stats) {
+    int size;
+    MPI_Comm_size(comm, &size);
+    int q = targets.size();
+    long long gather_limit = (long long)size * SELECT_SAMPLES;
+    
+    vector<int> lo(q, 0), hi(q, n);
+    vector<long long> r(targets);
+    vector<char> done(q, 0);
+    vector<Key> answers(q);
+    stats = {0, 0};
+    
+    vector<int> lengths(q), all_lengths((size_t)q * size), recvcounts(size), displs(size);
+    vector<Key> send, received;
+    vector<int64_t> local_counts, counts;
+    vector<Key> splitters;
+    while (find(done.begin(), done.end(), 0) != done.end()) {
+        stats.rounds++;
+        
+        // Candidatas de cada proceso por objetivo
+        for (int t = 0; t < q; t++) lengths[t] = done[t] ? 0 : hi[t] - lo[t];
+        MPI_Allgather(lengths.data(), q, MPI_INT, all_lengths.data(), q, MPI_INT, comm);
+        vector<long long> total(q, 0);
+        for (int p = 0; p < size; p++) {
+            for (int t = 0; t < q; t++) total[t] += all_lengths[(size_t)p * q + t];
+        }
+        
+        // Muestras (o todas las candidatas si son pocas) de cada proceso y objetivo
+        auto sent = [&](int length, int t) {
+            return total[t] <= gather_limit ? length : min(length, SELECT_SAMPLES);
+        };
+        send.clear();
+        for (int t = 0; t < q; t++) {
+            int length = lengths[t], count = sent(length, t);
+            for (int s = 0; s < count; s++) {
+                send.push_back(data[lo[t] + (int)((2LL * s + 1) * length / (2LL * count))]);
+            }
+        }
+        int offset = 0;
+        for (int p = 0; p < size; p++) {
+            recvcounts[p] = 0;
+            for (int t = 0; t < q; t++) recvcounts[p] += sent(all_lengths[(size_t)p * q + t], t);
+            displs[p] = offset;
+            offset += recvcounts[p];
+        }
+        received.resize(offset);
+        MPI_Datatype key_type = key_mpi_type<Key>();
+        MPI_Allgatherv(send.data(), send.size(), key_type, received.data(), recvcounts.data(), displs.data(),
+                       key_type, comm);
+        stats.bytes += (double)size * q * sizeof(int) + (double)offset * sizeof(Key);
+        
+        // Por objetivo: respuesta directa o muestras ordenadas como divisores
+        vector<vector<Key>> candidates(q);
+        for (int p = 0, position = 0; p < size; p++) {
+            for (int t = 0; t < q; t++) {
+                int count = sent(all_lengths[(size_t)p * q + t], t);
+                candidates[t].insert(candidates[t].end(), received.begin() + position,
+                                     received.begin() + position + count);
+                position += count;
+            }
+        }
+        local_counts.clear();
+        for (int t = 0; t < q; t++) {
+            if (done[t]) continue;
+            vector<Key>& values = candidates[t];
+            if (total[t] <= gather_limit) {
+                nth_element(values.begin(), values.begin() + r[t], values.end());
+                answers[t] = values[r[t]];
+                done[t] = 1;
+                continue;
+            }
+            sort(values.begin(), values.end());
+            values.erase(unique(values.begin(), values.end()), values.end());
+            for (Key s : values) {
+                local_counts.push_back(lower_bound(data + lo[t], data + hi[t], s) - (data + lo[t]));
+                local_counts.push_back(upper_bound(data + lo[t], data + hi[t], s) - (data + lo[t]));
+            }
+        }
+        if (local_counts.empty()) break;
+        counts.resize(local_counts.size());
+        MPI_Allreduce(local_counts.data(), counts.data(), counts.size(), MPI_INT64_T, MPI_SUM, comm);
+        stats.bytes += (double)size * counts.size() * sizeof(int64_t);
+        
+        // Hueco entre muestras que contiene la posición r
+        size_t position = 0;
+        for (int t = 0; t < q; t++) {
+            if (done[t]) continue;
+            const vector<Key>& values = candidates[t];
+            const int64_t* c = counts.data() + position;
+            position += 2 * values.size();
+            int m = -1;  // última muestra con # < s <= r
+            while (m + 1 < (int)values.size() && c[2 * (m + 1)] <= r[t]) m++;
+            if (m >= 0 && c[2 * m + 1] > r[t]) {
+                answers[t] = values[m];
+                done[t] = 1;
+                continue;
+            }
+            int new_lo = lo[t], new_hi = hi[t];
+            if (m >= 0) {
+                new_lo = upper_bound(data + lo[t], data + hi[t], values[m]) - data;
+                r[t] -= c[2 * m + 1];
+            }
+            if (m + 1 < (int)values.size()) {
+                new_hi = lower_bound(data + lo[t], data + hi[t], values[m + 1]) - data;
+            }
+            lo[t] = new_lo;
+            hi[t] = new_hi;
+        }
+    }
+    return answers;
+}
+
+template <typename Key>
+int run_select(const RunConfig& config, Key min_val, Key max_val,
+               const SelectTargets& targets, int rank, MPI_Comm row_comm, ThreadPool* pool) {
+    MPI_Comm comm = config.comm;
+    const Grid& grid = config.grid;
+    long long N = grid.N;
+    int size = grid.size();
+    auto [row, col] = rank_to_position(rank, grid);
+    
+    // Pipeline completo (fases 1-5) con la misma entrada, como referencia. Con
+    // el motor sort: histogram no pasa claves por las fases 2 y 5 y no habría
+    // bytes contra los que comparar
+    RunConfig full_config = config;
+    full_config.quiet = true;
+    full_config.verify = false;
+    Metrics full = {};
+    if (run_with_range<Key>(full_config, "sort", min_val, max_val, rank, row_comm, pool, &full) != 0) {
+        return 1;
+    }
+    
+    // Fase 1: bloque de la columna
+    MPI_Barrier(comm);
+    double start = MPI_Wtime();
+    vector<Key> local_data, row_block;
+    if (config.input_path.empty()) {
+        local_data = phase1_input_gossip(grid, min_val, max_val, rank, config.dist);
+    } else if (!phase1_input_file(config.input_path, grid, rank, false, local_data, row_block, comm)) {
+        return 1;
+    }
+    SortBackend sort_backend = config.sort_backend;
+    if (sort_backend == SortBackend::AUTO) {
+        sort_backend = choose_kernels(local_data, sort_backend, RankingKernel::BSEARCH).sort;
+    }
+    MPI_Barrier(comm);
+    double phase1_time = MPI_Wtime() - start;
+    
+    // Fase 3: sort del bloque; el proceso usa el tramo de su fila
+    start = MPI_Wtime();
+    phase3_sort(local_data, sort_backend, pool);
+    MPI_Barrier(comm);
+    double phase3_time = MPI_Wtime() - start;
+    int n = local_data.size();
+    int part_lo = block_part_begin(n, row, grid.rows), part_hi = block_part_begin(n, row + 1, grid.rows);
+    const Key* part = local_data.data() + part_lo;
+    int part_size = part_hi - part_lo;
+    
+    start = MPI_Wtime();
+    vector<long long> ks;
+    for (long long k : targets.ranks) ks.push_back(k - 1);
+    SelectStats stats;
+    vector<Key> answers = distributed_select(part, part_size, ks, comm, stats);
+    double select_time = MPI_Wtime() - start;
+    
+    // --verify: # < v <= k - 1 < # <= v para cada respuesta, con conteos exactos
+    long long mismatches = 0;
+    if (config.verify) {
+        vector<int64_t> local_counts, counts(2 * answers.size());
+        for (Key v : answers) {
+            local_counts.push_back(lower_bound(part, part + part_size, v) - part);
+            local_counts.push_back(upper_bound(part, part + part_size, v) - part);
+        }
+        MPI_Allreduce(local_counts.data(), counts.data(), counts.size(), MPI_INT64_T, MPI_SUM, comm);
+        for (size_t t = 0; t < answers.size(); t++) {
+            mismatches += !(counts[2 * t] <= ks[t] && ks[t] < counts[2 * t + 1]);
+        }
+    }
+    
+    if (rank != 0 || config.quiet) return mismatches > 0 ? 1 : 0;
+    
+    double total = phase1_time + phase3_time + select_time;
+    double pipeline_bytes = full.phase2_bytes + full.phase5_bytes;
+    cout << fixed << setprecision(6);
+    cout << "\n" << string(70, '=') << "\n";
+    cout << "SELECCIÓN DISTRIBUIDA - MÉTRICAS\n";
+    cout << string(70, '=') << "\n";
+    cout << "N:                 " << N << " claves " << KeyTraits<Key>::name << " (malla " << grid.rows << "x"
+         << grid.cols << ", P = " << size << ")\n";
+    cout << "Objetivos:         " << targets.ranks.size() << "\n";
+    size_t shown = min<size_t>(targets.ranks.size(), 20);
+    for (size_t t = 0; t < shown; t++) {
+        cout << "  " << targets.labels[t] << string(max<int>(1, 16 - targets.labels[t].size()), ' ')
+             << "k = " << targets.ranks[t] << ": " << +answers[t] << "\n";
+    }
+    if (shown < targets.ranks.size()) cout << "  ... (" << targets.ranks.size() - shown << " más)\n";
+    cout << "Fase 1 (Input):    " << phase1_time * 1000 << " ms\n";
+    cout << "Fase 3 (Sort):     " << phase3_time * 1000 << " ms (" << sort_backend_name(sort_backend) << ")\n";
+    cout << "Selección:         " << select_time * 1000 << " ms (" << stats.rounds << " rondas, "
+         << stats.bytes / 1024 << " KB en colectivas)\n";
+    cout << "Total:             " << total * 1000 << " ms\n";
+    cout << "Pipeline completo: " << full.total_time * 1000 << " ms (Tp), " << pipeline_bytes / 1024
+         << " KB en fases 2 y 5\n";
+    cout << "Speedup:           " << full.total_time / total << "x (tiempo), ";
+    if (pipeline_bytes > 0 && stats.bytes > 0) {
+        cout << pipeline_bytes / stats.bytes << "x menos bytes\n";
+    } else {
+        cout << "n/a en bytes\n";
+    }
+    if (config.verify) {
+        cout << "Verificación:      " << (mismatches == 0 ? "OK" : "FALLÓ") << " (# < v < k <= # <= v, "
+             << "conteos exactos)\n";
+    }
+    cout << string(70, '=') << "\n";
+    return mismatches > 0 ? 1 : 0;
+}
+
+// Modos de main que reemplazan la corrida del pipeline
+struct RunMode {
+    int window_steps = 0, window_batch = 0;  // --window S:B (0: no)
+    SelectTargets select;                     // --select (sin objetivos: no)
+};
+
+// Interpreta [min, max] en el tipo de clave (histogram solo con claves enteras)
+template <typename Key>
+bool parse_range(const string& engine_arg, const char* min_arg, const char* max_arg, int rank,
+                 Key& min_val, Key& max_val) {
+    if (!KeyTraits<Key>::parse(min_arg, min_val) || !KeyTraits<Key>::parse(max_arg, max_val)) {
+        if (rank == 0) {
+            cerr << "ERROR: [" << min_arg << ", " << max_arg << "] no es un rango válido para claves "
+                 << KeyTraits<Key>::name << "\n";
+        }
+        return false;
+    }
+    
+    if (min_val >= max_val) {
+        if (rank == 0) cerr << "ERROR: min debe ser menor que max\n";
+        return false;
+    }
+    
+    if (engine_arg == "histogram" && !is_integral_v<Key>) {
+        if (rank == 0) cerr << "ERROR: el motor histogram requiere claves enteras\n";
+        return false;
+    }
+    
+    if (engine_arg == "histogram" && !histogram_range_fits(min_val, max_val)) {
+        if (rank == 0) {
+            cerr << "ERROR: el motor histogram admite hasta " << (long long)HISTOGRAM_MAX_VALUES
+                 << " valores en [min, max]; usar --engine sort\n";
+        }
+        return false;
+    }
+    return true;
+}
+
+template <typename Key>
+int run_with_key(RunConfig config, const string& engine_arg, const char* min_arg, const char* max_arg,
+                 int rank, MPI_Comm row_comm, ThreadPool* pool, Metrics* result = nullptr,
+                 const RunMode& mode = RunMode()) {
+    Key min_val, max_val;
+    if (!parse_range(engine_arg, min_arg, max_arg, rank, min_val, max_val)) return 1;
+    
+    if (mode.window_steps > 0) {
+        return run_window<Key>(config, engine_arg, min_val, max_val, mode.window_steps, mode.window_batch,
+                               rank, row_comm, pool);
+    }
+    if (!mode.select.ranks.empty()) {
+        return run_select<Key>(config, min_val, max_val, mode.select, rank, row_comm, pool);
+    }
+    return run_with_range<Key>(config, engine_arg, min_val, max_val, rank, row_comm, pool, result);
+}
+
+// ===== MODO SERVICIO (--serve) =====
+// Un solo trabajo MPI rankea una secuencia de lotes (protocolo en
+// batch_source.h). La malla, los comunicadores de fila y columna, el pool y
+// los buffers del reparto se crean una vez. Por lote: rank 0 lo lee y difunde
+// {count, min, max}; la malla corre las fases 1-6 con ese rango (el motor auto
+// puede elegir histogram lote a lote) y los dueños de los rankings los juntan
+// en rank 0, que los ubica en el orden del pedido y responde. Los lotes con
+// menos claves que procesos los rankea rank 0 solo. Con -v se reporta cada
+// lote; al terminar, percentiles de latencia y throughput.
+enum ServeState { SERVE_BATCH, SERVE_END, SERVE_ERROR };
+
+template <typename Key>
+struct BatchHeader {
+    int state;
+    uint64_t count;
+    Key min_val, max_val;
+};
+
+// Junta en rank 0 los rankings de los dueños (MPI_Gatherv, en orden de rank)
+// y los ubica en las posiciones del lote (owned_ranking_segments)
+template <typename Key>
+void gather_batch_ranking(ServiceBuffers<Key>& buffers, const Grid& grid, int rank, MPI_Comm comm) {
+    int size = grid.size();
+    int count = buffers.ranking.size();
+    vector<int> counts(size), displs(size, 0);
+    TraceScope scope("MPI_Gatherv (rankings)", "colectiva");
+    MPI_Gather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, comm);
+    for (int r = 1; r < size; r++) displs[r] = displs[r - 1] + counts[r - 1];
+    if (rank == 0) buffers.gathered.resize(displs[size - 1] + counts[size - 1]);
+    MPI_Gatherv(buffers.ranking.data(), count, MPI_INT64_T, buffers.gathered.data(), counts.data(),
+                displs.data(), MPI_INT64_T, 0, comm);
+    if (rank != 0) return;
+    
+    buffers.response.resize(grid.N);
+    size_t k = 0;
+    for (int r = 0; r < size; r++) {
+        for (const auto& [begin, length] : owned_ranking_segments(buffers.engine, buffers.scattered, r, grid)) {
+            copy_n(buffers.gathered.begin() + k, length, buffers.response.begin() + begin);
+            k += length;
+        }
+    }
 }
 
-// ===== CÁLCULO DE FLOPs =====
-long long calculate_flops(int N, int p) {
-    // Trabajo por proceso
-    int n = N / p;  // Elementos por proceso
-    
-    // Sort: n log(n) comparaciones/swaps
-    long long sort_ops = (long long)n * (long long)log2(n);
+// Lote con menos claves que procesos, en rank 0: # <= v, o con destinations
+// una posición única del orden (valor, índice); un lote de la malla desempata
+// como la fase 6, que también es un orden estable válido
+template <typename Key>
+void rank_small_batch(const vector<Key>& keys, bool destinations, vector<int64_t>& ranking) {
+    size_t n = keys.size();
+    vector<size_t> order(n);
+    for (size_t i = 0; i < n; i++) order[i] = i;
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return keys[a] < keys[b]; });
+    ranking.resize(n);
+    for (size_t i = 0; i < n;) {
+        size_t j = i + 1;
+        while (j < n && !(keys[order[i]] < keys[order[j]])) j++;
+        for (size_t k = i; k < j; k++) ranking[order[k]] = destinations ? k : j;
+        i = j;
+    }
+}
+
+template <typename Key>
+int serve(const RunConfig& config, const string& engine_arg, const string& spec, int rank,
+          MPI_Comm row_comm, ThreadPool* pool) {
+    MPI_Comm comm = config.comm;
+    const Grid& grid = config.grid;
+    int size = grid.size();
+    auto [row, col] = rank_to_position(rank, grid);
     
-    // Ranking: n búsquedas binarias, cada una O(log n)
-    long long ranking_ops = (long long)n * (long long)log2(n);
+    if (engine_arg == "histogram" && !is_integral_v<Key>) {
+        if (rank == 0) cerr << "ERROR: el motor histogram requiere claves enteras\n";
+        return 1;
+    }
     
-    // Total por proceso
-    long long ops_per_process = sort_ops + ranking_ops;
+    // El transporte vive en rank 0; el resto solo necesita saber si se abrió
+    unique_ptr<BatchSource> source;
+    int opened = 1;
+    if (rank == 0) {
+        signal(SIGPIPE, SIG_IGN);  // un cliente que se va no termina el servicio
+        string error;
+        source = BatchSource::create(spec, error);
+        if (!source) {
+            cerr << "ERROR: --serve " << spec << ": " << error << "\n";
+            opened = 0;
+        }
+    }
+    MPI_Bcast(&opened, 1, MPI_INT, 0, comm);
+    if (!opened) return 1;
     
-    // Total en el sistema (P procesos)
-    long long total_ops = ops_per_process * (p * p);
+    ServiceBuffers<Key> buffers = {};
+    MPI_Comm_split(comm, col, row, &buffers.col_comm);
     
-    return total_ops;
-}
-
-// ===== IMPRESIÓN DE MÉTRICAS =====
-void print_metrics(int rank, int size, int N, int p, const Metrics& m, double Ts, bool verbose) {
     if (rank == 0) {
-        cout << "\n" << string(70, '=') << "\n";
-        cout << "RANKING SORT PARALELO - MÉTRICAS DE PERFORMANCE\n";
-        cout << string(70, '=') << "\n";
-        
         cout << fixed << setprecision(3);
-        
-        // Configuración
-        cout << "Configuración:\n";
-        cout << "  N (elementos):     " << N << "\n";
-        cout << "  P (procesos):      " << size << " (malla " << p << "×" << p << ")\n";
-        cout << "  Elementos/proceso: " << (N/p) << "\n\n";
-        
-        // Tiempos
-        cout << "Tiempos:\n";
-        cout << "  Total (Tp):        " << (m.total_time * 1000) << " ms\n";
-        cout << "  - Cómputo:         " << (m.compute_time * 1000) << " ms ("
-             << (m.compute_time/m.total_time*100) << "%)\n";
-        cout << "  - Comunicación:    " << (m.comm_time * 1000) << " ms ("
-             << (m.comm_time/m.total_time*100) << "%)\n";
-        
-        if (verbose) {
-            cout << "\n  Desglose detallado:\n";
-            cout << "    Fase 1 (Input):    " << (m.phase1_time * 1000) << " ms\n";
-            cout << "    Fase 2 (Bcast):    " << (m.phase2_time * 1000) << " ms\n";
-            cout << "    Fase 3 (Sort):     " << (m.phase3_time * 1000) << " ms\n";
-            cout << "    Fase 4 (Ranking):  " << (m.phase4_time * 1000) << " ms\n";
-            cout << "    Fase 5 (Reduce):   " << (m.phase5_time * 1000) << " ms\n";
+        cout << "SERVICIO: " << spec << " (malla " << grid.rows << "x" << grid.cols << ", claves "
+             << KeyTraits<Key>::name << ")\n" << flush;
+    }
+    
+    vector<double> latencies;
+    double ranking_total = 0;
+    long long keys_total = 0;
+    int batches = 0, rejected = 0, status = 0;
+    
+    while (true) {
+        BatchHeader<Key> header = {SERVE_END, 0, Key(), Key()};
+        double received = 0;
+        if (rank == 0) {
+            BatchStatus got = source->next(buffers.keys);
+            received = MPI_Wtime();
+            if (got == BatchStatus::ERROR) {
+                cerr << "ERROR: " << source->error() << "\n";
+                header.state = SERVE_ERROR;
+            } else if (got == BatchStatus::BATCH) {
+                header.state = SERVE_BATCH;
+                header.count = buffers.keys.size();
+                if (header.count > 0) {
+                    auto [lo, hi] = minmax_element(buffers.keys.begin(), buffers.keys.end());
+                    header.min_val = *lo;
+                    header.max_val = *hi;
+                }
+            }
         }
-        
-        // Rendimiento (si Ts disponible)
-        if (Ts > 0) {
-            double speedup = Ts / m.total_time;
-            double efficiency = speedup / size;
-            double speedup_ideal = size;
-            
-            cout << "\nRendimiento:\n";
-            cout << "  Ts (secuencial):   " << (Ts * 1000) << " ms\n";
-            cout << "  Speedup (S):       " << speedup << "x\n";
-            cout << "  Eficiencia (E):    " << (efficiency * 100) << "%\n\n";
-            
-            cout << "  Speedup ideal:     " << speedup_ideal << "x\n";
-            cout << "  % del ideal:       " << (speedup/speedup_ideal*100) << "%\n";
+        MPI_Bcast(&header, sizeof(header), MPI_BYTE, 0, comm);
+        if (header.state != SERVE_BATCH) {
+            status = (header.state == SERVE_ERROR) ? 1 : 0;
+            break;
         }
+        batches++;
         
-        // FLOPs
-        long long flops = calculate_flops(N, p);
-        double flops_per_sec = flops / m.compute_time;  // Usar solo tiempo de cómputo
-        double gflops = flops_per_sec / 1e9;
-        double mflops = flops_per_sec / 1e6;
-        
-        cout << "\nFLOPs:\n";
-        cout << "  Operaciones:       " << flops << "\n";
-        cout << "  FLOP/s:            " << flops_per_sec << "\n";
-        cout << "  MFLOP/s:           " << mflops << "\n";
-        cout << "  GFLOP/s:           " << gflops << "\n";
-        
-        // Throughput
-        double throughput = N / m.total_time;
-        cout << "\nThroughput:\n";
-        cout << "  Elementos/seg:     " << throughput << "\n";
-        
-        // Balance
-        if (m.comm_time > 0) {
-            cout << "\nBalance:\n";
-            cout << "  Cómputo/Comm:      " << (m.compute_time/m.comm_time) << "x\n";
+        // Cada lote es una corrida sobre la misma malla con N = count
+        // Con --engine histogram un lote de rango muy amplio se rechaza (count = 0)
+        // en lugar de agotar la memoria de todos los procesos
+        long long N = header.count;
+        Metrics metrics = {};
+        bool accepted = N > 0 &&
+                        (engine_arg != "histogram" || histogram_range_fits(header.min_val, header.max_val));
+        if (N >= size && accepted) {
+            RunConfig batch_config = config;
+            batch_config.grid.N = N;
+            batch_config.quiet = true;
+            accepted = run_with_range<Key>(batch_config, engine_arg, header.min_val, header.max_val, rank,
+                                           row_comm, pool, &metrics, &buffers) == 0;
+            if (accepted) gather_batch_ranking(buffers, batch_config.grid, rank, comm);
+        } else if (rank == 0 && accepted) {
+            double start = MPI_Wtime();
+            rank_small_batch(buffers.keys, config.sorted_output, buffers.response);
+            metrics.total_time = MPI_Wtime() - start;
         }
+        if (rank != 0) continue;
         
+        double latency = MPI_Wtime() - received;
+        BatchReply reply = {accepted ? (uint64_t)N : 0, latency * 1000, metrics.total_time * 1000,
+                            accepted ? N / latency : 0};
+        if (!source->reply(reply, buffers.response.data())) {
+            cerr << "AVISO: no se pudo enviar la respuesta del lote " << batches << "\n";
+        }
+        if (accepted) {
+            latencies.push_back(latency);
+            ranking_total += metrics.total_time;
+            keys_total += N;
+        } else {
+            rejected++;
+        }
+        if (config.verbose) {
+            cout << "Lote " << batches << ": " << N << " claves, "
+                 << (N >= size ? engine_name(buffers.engine) : "rank 0")
+                 << (accepted ? "" : " (rechazado)") << ", latencia " << reply.latency_ms << " ms (Tp "
+                 << reply.ranking_ms << " ms), " << reply.keys_per_sec / 1e6 << " M claves/s\n" << flush;
+        }
+    }
+    
+    if (rank == 0) {
+        sort(latencies.begin(), latencies.end());
+        double latency_total = 0;
+        for (double l : latencies) latency_total += l;
+        cout << "\n" << string(70, '=') << "\n";
+        cout << "SERVICIO - MÉTRICAS\n";
         cout << string(70, '=') << "\n";
-        
-        // CSV para análisis
-        cout << "\nFORMATO CSV:\n";
-        cout << "P,N,p,Tp_ms,compute_ms,comm_ms,";
-        if (Ts > 0) cout << "Ts_ms,speedup,efficiency,";
-        cout << "flops,gflops,throughput\n";
-        
-        cout << size << "," << N << "," << p << ","
-             << (m.total_time*1000) << ","
-             << (m.compute_time*1000) << ","
-             << (m.comm_time*1000) << ",";
-        
-        if (Ts > 0) {
-            cout << (Ts*1000) << ","
-                 << (Ts/m.total_time) << ","
-                 << ((Ts/m.total_time)/size) << ",";
+        cout << "Lotes:             " << batches << " (" << rejected << " rechazados)\n";
+        cout << "Claves rankeadas:  " << keys_total << "\n";
+        if (!latencies.empty()) {
+            cout << "Latencia (ms):     p50 " << percentile(latencies, 0.50) * 1000 << " | p90 "
+                 << percentile(latencies, 0.90) * 1000 << " | p99 " << percentile(latencies, 0.99) * 1000
+                 << " | máx " << latencies.back() * 1000 << "\n";
+            cout << "Throughput:        " << keys_total / latency_total / 1e6 << " M claves/s (latencia)";
+            if (ranking_total > 0) cout << ", " << keys_total / ranking_total / 1e6 << " M claves/s (Tp)";
+            cout << "\n";
         }
-        
-        cout << flops << ","
-             << gflops << ","
-             << throughput << "\n";
+        cout << string(70, '=') << "\n";
     }
+    
+    MPI_Comm_free(&buffers.col_comm);
+    return status;
 }
 
-// ===== IMPRESIÓN DE RESULTADOS POR PROCESO =====
-void print_process_data(
-    int rank, int p,
-    const vector<int>& original,
-    const vector<int>& sorted_local,
-    const vector<int>& broadcasted,
-    const vector<int>& local_ranking,
-    const vector<int>& reduced_ranking
-) {
-    auto [row, col] = rank_to_position(rank, p);
-    bool is_diag = is_diagonal(rank, p);
-    
-    cout << "\n" << string(70, '-') << "\n";
-    cout << "Proceso " << rank << " (fila=" << row << ", col=" << col << ")";
-    if (is_diag) cout << " [DIAGONAL]";
-    cout << "\n" << string(70, '-') << "\n";
+// ===== CONSULTAS SOBRE DATOS RESIDENTES (--query) =====
+// Tras las fases 1 y 3 cada columna tiene su bloque ordenado, que alcanza para
+// contar # <= x de valores externos. En modo consulta los bloques (y el índice
+// Eytzinger del kernel index) quedan en memoria y se atienden lotes de valores:
+//   rank 0 reparte tramos contiguos del lote en la columna 0 (MPI_Scatterv)
+//   (i, 0) difunde el tramo de la fila i a toda la fila (MPI_Bcast)
+//   cada proceso cuenta el tramo en su bloque con el kernel de la fase 4
+//   la fila suma en (i, 0) (MPI_Reduce) y rank 0 junta los tramos (MPI_Gatherv)
+// Los lotes llegan por un transporte de --serve (batch_source.h; la respuesta
+// trae los conteos int64 en el orden del pedido) o, con gen:B:Q, son B lotes
+// de Q valores uniformes en [min, max] generados en rank 0 (benchmark sin
+// cliente). Se reportan consultas por segundo y percentiles de latencia.
+const uint64_t QUERY_SEED = 7;  // valores de gen:B:Q (distintos de los datos)
+
+template <typename Key>
+int run_query(const RunConfig& config, const char* min_arg, const char* max_arg, const string& spec,
+              int rank, MPI_Comm row_comm, ThreadPool* pool) {
+    MPI_Comm comm = config.comm;
+    const Grid& grid = config.grid;
+    auto [row, col] = rank_to_position(rank, grid);
     
-    int show = min(12, (int)original.size());
+    Key min_val, max_val;
+    if (!parse_range("sort", min_arg, max_arg, rank, min_val, max_val)) return 1;
     
-    cout << "Original:       [";
-    for (int i = 0; i < show; i++) {
-        cout << setw(4) << original[i];
-        if (i < show - 1) cout << ",";
+    // Fuente: gen:B:Q en todos los procesos; un transporte solo en rank 0
+    int gen_batches = 0, gen_size = 0;
+    bool generated = spec.rfind("gen:", 0) == 0;
+    if (generated && (sscanf(spec.c_str(), "gen:%d:%d", &gen_batches, &gen_size) != 2 || gen_batches < 1 ||
+                      gen_size < 1)) {
+        if (rank == 0) cerr << "ERROR: --query " << spec << ": se espera gen:B:Q con B, Q >= 1\n";
+        return 1;
     }
-    if (original.size() > (size_t)show) cout << ", ...";
-    cout << "]\n";
+    unique_ptr<BatchSource> source;
+    int opened = 1;
+    if (rank == 0 && !generated) {
+        signal(SIGPIPE, SIG_IGN);  // un cliente que se va no termina el servicio
+        string error;
+        source = BatchSource::create(spec, error);
+        if (!source) {
+            cerr << "ERROR: --query " << spec << ": " << error << "\n";
+            opened = 0;
+        }
+    }
+    MPI_Bcast(&opened, 1, MPI_INT, 0, comm);
+    if (!opened) return 1;
     
-    cout << "Sorted:         [";
-    for (int i = 0; i < show; i++) {
-        cout << setw(4) << sorted_local[i];
-        if (i < show - 1) cout << ",";
+    // Datos residentes: fases 1 y 3 una sola vez (y el índice si corresponde)
+    MPI_Barrier(comm);
+    double start = MPI_Wtime();
+    vector<Key> local_data, row_block;
+    if (config.input_path.empty()) {
+        local_data = phase1_input_gossip(grid, min_val, max_val, rank, config.dist);
+    } else if (!phase1_input_file(config.input_path, grid, rank, false, local_data, row_block, comm)) {
+        return 1;
     }
-    if (sorted_local.size() > (size_t)show) cout << ", ...";
-    cout << "]\n";
+    // Los lotes no tienen la forma de los datos: auto usa el índice
+    RankingKernel kernel = (config.ranking_kernel == RankingKernel::AUTO) ? RankingKernel::INDEX
+                                                                            : config.ranking_kernel;
+    SortBackend sort_backend = config.sort_backend;
+    if (sort_backend == SortBackend::AUTO) sort_backend = choose_kernels(local_data, sort_backend, kernel).sort;
+    phase3_sort(local_data, sort_backend, pool);
+    EytzingerIndex<Key> index;
+    if (kernel == RankingKernel::INDEX) index.build(local_data);
+    MPI_Barrier(comm);
+    double load_time = MPI_Wtime() - start;
+    double resident_bytes = local_data.size() * sizeof(Key) * (kernel == RankingKernel::INDEX ? 2 : 1);
     
-    cout << "Broadcasted:    [";
-    for (int i = 0; i < show; i++) {
-        cout << setw(4) << broadcasted[i];
-        if (i < show - 1) cout << ",";
+    MPI_Comm col_comm;
+    MPI_Comm_split(comm, col, row, &col_comm);
+    MPI_Datatype key_type = key_mpi_type<Key>();
+    
+    if (rank == 0) {
+        cout << fixed << setprecision(3);
+        cout << "CONSULTAS: " << spec << " sobre N = " << grid.N << " claves " << KeyTraits<Key>::name
+             << " (malla " << grid.rows << "x" << grid.cols << ", kernel " << ranking_kernel_name(kernel)
+             << ", carga " << load_time * 1000 << " ms)\n" << flush;
     }
-    if (broadcasted.size() > (size_t)show) cout << ", ...";
-    cout << "]\n";
     
-    cout << "Local Ranking:  [";
-    for (int i = 0; i < show; i++) {
-        cout << setw(4) << local_ranking[i];
-        if (i < show - 1) cout << ",";
+    vector<Key> batch, chunk;
+    vector<int64_t> partial, counts, response;
+    vector<int> row_counts(grid.rows), row_displs(grid.rows);
+    vector<double> latencies;
+    long long queries_total = 0;
+    int batches = 0, rejected = 0, status = 0;
+    double serve_start = MPI_Wtime();
+    
+    while (true) {
+        BatchHeader<Key> header = {SERVE_END, 0, Key(), Key()};
+        double received = 0;
+        if (rank == 0) {
+            if (generated) {
+                if (batches < gen_batches) {
+                    batch.resize(gen_size);
+                    philox_fill(batch.data(), (uint64_t)batches * gen_size, gen_size, min_val, max_val,
+                                QUERY_SEED);
+                    header.state = SERVE_BATCH;
+                }
+            } else {
+                BatchStatus got = source->next(batch);
+                if (got == BatchStatus::ERROR) cerr << "ERROR: " << source->error() << "\n";
+                header.state = (got == BatchStatus::BATCH) ? SERVE_BATCH
+                             : (got == BatchStatus::END) ? SERVE_END : SERVE_ERROR;
+            }
+            header.count = batch.size();
+            received = MPI_Wtime();
+        }
+        MPI_Bcast(&header, sizeof(header), MPI_BYTE, 0, comm);
+        if (header.state != SERVE_BATCH) {
+            status = (header.state == SERVE_ERROR) ? 1 : 0;
+            break;
+        }
+        batches++;
+        
+        // Tramo de cada fila: a la columna 0 y de ahí a lo largo de la fila
+        int q = header.count;
+        for (int r = 0; r < grid.rows; r++) {
+            row_displs[r] = block_part_begin(q, r, grid.rows);
+            row_counts[r] = block_part_begin(q, r + 1, grid.rows) - row_displs[r];
+        }
+        int own = row_counts[row];
+        chunk.resize(own);
+        if (col == 0) {
+            MPI_Scatterv(batch.data(), row_counts.data(), row_displs.data(), key_type, chunk.data(), own,
+                         key_type, 0, col_comm);
+        }
+        MPI_Bcast(chunk.data(), own, key_type, 0, row_comm);
+        
+        vector<int> local = phase4_rank(kernel, local_data, index, chunk, pool);
+        partial.assign(local.begin(), local.end());
+        counts.resize(own);
+        MPI_Reduce(partial.data(), counts.data(), own, MPI_INT64_T, MPI_SUM, 0, row_comm);
+        if (col == 0) {
+            response.resize(rank == 0 ? q : 0);
+            MPI_Gatherv(counts.data(), own, MPI_INT64_T, response.data(), row_counts.data(), row_displs.data(),
+                        MPI_INT64_T, 0, col_comm);
+        }
+        if (rank != 0) continue;
+        
+        double latency = MPI_Wtime() - received;
+        bool accepted = q > 0;
+        if (accepted) {
+            latencies.push_back(latency);
+            queries_total += q;
+        } else {
+            rejected++;
+        }
+        if (source) {
+            BatchReply reply = {(uint64_t)q, latency * 1000, latency * 1000, accepted ? q / latency : 0};
+            if (!source->reply(reply, response.data())) {
+                cerr << "AVISO: no se pudo enviar la respuesta del lote " << batches << "\n";
+            }
+        }
+        if (config.verbose) {
+            cout << "Lote " << batches << ": " << q << " consultas" << (accepted ? "" : " (rechazado)")
+                 << ", latencia " << latency * 1000 << " ms, " << (accepted ? q / latency / 1e6 : 0)
+                 << " M consultas/s\n" << flush;
+        }
     }
-    if (local_ranking.size() > (size_t)show) cout << ", ...";
-    cout << "]\n";
+    double serve_time = MPI_Wtime() - serve_start;
     
-    if (is_diag) {
-        cout << "Global Ranking: [";
-        for (int i = 0; i < show; i++) {
-            cout << setw(4) << reduced_ranking[i];
-            if (i < show - 1) cout << ",";
+    if (rank == 0) {
+        sort(latencies.begin(), latencies.end());
+        double latency_total = 0;
+        for (double l : latencies) latency_total += l;
+        cout << "\n" << string(70, '=') << "\n";
+        cout << "CONSULTAS - MÉTRICAS\n";
+        cout << string(70, '=') << "\n";
+        cout << "Residente:         " << resident_bytes / 1e6 << " MB por proceso (bloque"
+             << (kernel == RankingKernel::INDEX ? " + índice" : "") << "), carga " << load_time * 1000
+             << " ms (fases 1 y 3)\n";
+        cout << "Lotes:             " << batches << " (" << rejected << " rechazados)\n";
+        cout << "Consultas:         " << queries_total << "\n";
+        if (!latencies.empty()) {
+            cout << "Latencia (ms):     p50 " << percentile(latencies, 0.50) * 1000 << " | p90 "
+                 << percentile(latencies, 0.90) * 1000 << " | p99 " << percentile(latencies, 0.99) * 1000
+                 << " | máx " << latencies.back() * 1000 << "\n";
+            cout << "QPS:               " << queries_total / latency_total / 1e6 << " M consultas/s (latencia)";
+            if (generated) cout << ", " << queries_total / serve_time / 1e6 << " M consultas/s (pared)";
+            cout << "\n";
         }
-        if (reduced_ranking.size() > (size_t)show) cout << ", ...";
-        cout << "]\n";
+        cout << string(70, '=') << "\n";
     }
+    
+    MPI_Comm_free(&col_comm);
+    return status;
 }
 
 // ===== MAIN =====
+// ranking_bench.cpp incluye este archivo sin su main para reusar el motor
+#ifndef RANKING_SORT_NO_MAIN
 int main(int argc, char** argv) {
-    MPI_Init(&argc, &argv);
+    // FUNNELED: en modo híbrido solo el hilo principal llama a MPI
+    int thread_support;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &thread_support);
     
     int rank, size;
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
     
+    // Con --serve no hay N, min ni max: los da cada lote
+    string serve_spec;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (string(argv[i]) == "--serve") serve_spec = argv[i + 1];
+    }
+    
     // Verificar argumentos
-    if (argc < 4) {
+    if (argc < 4 && serve_spec.empty()) {
         if (rank == 0) {
             cerr << "Uso: mpirun -np P " << argv[0] << " [Ts] <N> <min> <max> [opciones]\n";
+            cerr << "     mpirun -np P " << argv[0] << " --serve SPEC [opciones]\n";
             cerr << "\nArgumentos:\n";
             cerr << "  Ts:  Tiempo secuencial en SEGUNDOS (opcional, para calcular speedup)\n";
             cerr << "  N:   Número de elementos\n";
-            cerr << "  min: Valor mínimo aleatorio\n";
-            cerr << "  max: Valor máximo aleatorio\n";
+            cerr << "  min: Valor mínimo aleatorio (en el tipo de --key)\n";
+            cerr << "  max: Valor máximo aleatorio (en el tipo de --key)\n";
             cerr << "\nOpciones:\n";
             cerr << "  -v, --verbose   Desglose detallado de tiempos por fase\n";
             cerr << "  -r, --results   Mostrar datos de cada proceso\n";
+            cerr << "  --ranking K     Kernel de la fase 4: bsearch (defecto) | merge | index | auto\n";
+            cerr << "  --engine E      Motor: auto (defecto) | sort | histogram\n";
+            cerr << "                  auto usa histogram si el rango cabe en caché L2\n";
+            cerr << "  --sort S        Sort de la fase 3: std (defecto) | radix | auto\n";
+            cerr << "                  Con auto cada proceso muestrea su bloque y elige el kernel\n";
+            cerr << "                  para esa forma de datos (se reporta la elección)\n";
+            cerr << "  -s, --sorted    Fase 6: redistribuir al orden global (MPI_Alltoallv);\n";
+            cerr << "                  el ranking pasa a ser la posición destino única\n";
+            cerr << "  --output F      Escribir el arreglo ordenado en F con MPI-IO (implica -s)\n";
+            cerr << "  --input F       Leer las N claves (binario del tipo de --key) de F con MPI-IO\n";
+            cerr << "                  en lugar de generarlos\n";
+            cerr << "  --dist D        Forma de los datos generados: uniform (defecto) | sorted |\n";
+            cerr << "                  reverse | nearly-sorted | few-unique | gaussian | zipf\n";
+            cerr << "  --threads T     Hilos por proceso (defecto 1). Con T > 1 las fases 3 y 4\n";
+            cerr << "                  corren en un pool con work stealing (modo híbrido)\n";
+            cerr << "  --pipeline S    Fases 2-5 solapadas: broadcast en S segmentos (MPI_Ibcast)\n";
+            cerr << "                  durante el sort, ranking y MPI_Ireduce por segmento\n";
+            cerr << "  --scatter       Fase 5 con MPI_Reduce_scatter: cada proceso de la fila se\n";
+            cerr << "                  queda con su parte (~N/P rankings, partes desiguales si P\n";
+            cerr << "                  no divide a N) en lugar de la raíz\n";
+            cerr << "  --grid RxC      Malla de R filas × C columnas (R·C = P). Por defecto la\n";
+            cerr << "                  más cuadrada posible; N no necesita ser múltiplo de P\n";
+            cerr << "  --compress      Fases 2 y 5 comprimidas: broadcast con frame-of-reference +\n";
+            cerr << "                  bit-packing y rankings parciales en log2(N) bits (MPI_Op\n";
+            cerr << "                  propio). No se combina con --pipeline\n";
+            cerr << "  --no-barriers   Sin barreras entre fases: cada proceso mide sus fases y se\n";
+            cerr << "                  reportan mín/media/máx/desbalance por fase\n";
+            cerr << "  --trace F       Traza JSON (Chrome trace, se abre en Perfetto) con fases,\n";
+            cerr << "                  colectivas y segmentos del pipeline de cada proceso\n";
+            cerr << "  --counters      Contadores por fase (perf_event_open): ciclos, instrucciones,\n";
+            cerr << "                  fallos de LLC, de saltos y de página; sin contadores de\n";
+            cerr << "                  hardware usa los de software que haya\n";
+            cerr << "  --verify        Verificar el ranking global sin juntarlo (fuera de Tp):\n";
+            cerr << "                  conteos exactos por corte, checksums de permutación y de\n";
+            cerr << "                  la salida (-s) y muestras contra el generador\n";
+            cerr << "  --key K         Tipo de clave: int (defecto) | char | int64 | float | double.\n";
+            cerr << "                  min, max y los archivos de --input/--output usan ese tipo\n";
+            cerr << "  --serve SPEC    Servicio: rankear lotes hasta que el cliente termine, en una\n";
+            cerr << "                  sola malla. SPEC: pipe:RUTA | socket:RUTA | spool:DIR\n";
+            cerr << "                  (protocolo en batch_source.h). -v reporta cada lote; al\n";
+            cerr << "                  final, percentiles de latencia y throughput\n";
+            cerr << "  --window S:B    Ventana deslizante de N claves: S pasos en los que llegan B\n";
+            cerr << "                  claves, vencen las B más viejas y se rankean las nuevas con\n";
+            cerr << "                  un árbol de estadísticos de orden por columna (order_stat_tree.h).\n";
+            cerr << "                  Compara el paso contra recalcular todo (Tp)\n";
+            cerr << "  --select L      Selección distribuida sin ranking completo: k-ésimas menores\n";
+            cerr << "                  de la lista L (q en [0, 1], pQ, top:K o k entero; ej.\n";
+            cerr << "                  p50,p99,top:100) con muestreo de divisores y rondas de\n";
+            cerr << "                  MPI_Allreduce sobre los bloques de la fase 3\n";
+            cerr << "  --query SRC     Consultas # <= x sobre los bloques ordenados, que quedan en\n";
+            cerr << "                  memoria: lotes de un transporte de --serve (la respuesta trae\n";
+            cerr << "                  los conteos) o gen:B:Q (B lotes de Q valores al azar).\n";
+            cerr << "                  Kernel de --ranking (defecto y auto: index). Reporta QPS y\n";
+            cerr << "                  percentiles de latencia\n";
             cerr << "\nEjemplos:\n";
             cerr << "  # Sin speedup:\n";
             cerr << "  mpirun -np 4 " << argv[0] << " 1000 1 100\n";
@@ -341,153 +3620,340 @@ int main(int argc, char** argv) {
             cerr << "  Ts=$(./sequential 1000 1 100 --time-only)\n";
             cerr << "  mpirun -np 4 " << argv[0] << " $Ts 1000 1 100 -v\n\n";
             cerr << "  # Con resultados detallados:\n";
-            cerr << "  mpirun -np 4 " << argv[0] << " 0.5 1000 1 100 -v -r\n";
+            cerr << "  mpirun -np 4 " << argv[0] << " 0.5 1000 1 100 -v -r\n\n";
+            cerr << "  # Comparar kernels de ranking:\n";
+            cerr << "  mpirun -np 4 " << argv[0] << " 1000000 1 1000000 -v --ranking merge\n\n";
+            cerr << "  # Híbrido: 4 procesos × 8 hilos en lugar de 32 procesos:\n";
+            cerr << "  mpirun -np 4 " << argv[0] << " 2822400 1 20000000 -v --threads 8\n";
         }
         MPI_Finalize();
         return 1;
     }
     
-    // Parsear Ts (opcional)
+    // Con --serve la malla se valida con N = P (cada lote trae el suyo)
     double Ts = -1;
-    int arg_offset = 1;
-    
-    char* endptr;
-    double first_arg = strtod(argv[1], &endptr);
-    if (*endptr == '\0' && first_arg > 0 && first_arg < 1000) {
-        // Es un número razonable, probablemente Ts
-        Ts = first_arg;
-        arg_offset = 2;
-    }
+    long long N = size;
+    const char* min_arg = "0";
+    const char* max_arg = "1";
+    int options_start = 1;
     
-    if (argc < arg_offset + 3) {
-        if (rank == 0) cerr << "ERROR: Argumentos insuficientes\n";
-        MPI_Finalize();
-        return 1;
+    if (serve_spec.empty()) {
+        // Parsear Ts (opcional)
+        int arg_offset = 1;
+        char* endptr;
+        double first_arg = strtod(argv[1], &endptr);
+        if (*endptr == '\0' && first_arg > 0 && first_arg < 1000) {
+            // Es un número razonable, probablemente Ts
+            Ts = first_arg;
+            arg_offset = 2;
+        }
+        
+        if (argc < arg_offset + 3) {
+            if (rank == 0) cerr << "ERROR: Argumentos insuficientes\n";
+            MPI_Finalize();
+            return 1;
+        }
+        
+        // Parsear parámetros obligatorios ([min, max] se interpreta según --key)
+        N = atoll(argv[arg_offset]);
+        min_arg = argv[arg_offset + 1];
+        max_arg = argv[arg_offset + 2];
+        options_start = arg_offset + 3;
     }
     
-    // Parsear parámetros obligatorios
-    int N = atoi(argv[arg_offset]);
-    int min_val = atoi(argv[arg_offset + 1]);
-    int max_val = atoi(argv[arg_offset + 2]);
-    
     // Parsear opciones
     bool verbose = false;
     bool show_results = false;
+    RankingKernel ranking_kernel = RankingKernel::BSEARCH;
+    bool ranking_set = false;
+    string engine_arg = "auto";
+    SortBackend sort_backend = SortBackend::STD;
+    int threads = 1;
+    string input_path;
+    string output_path;
+    bool sorted_output = false;
+    int pipeline_segments = 0;
+    bool scatter_ranking = false;
+    string grid_arg;
+    string key_arg = "int";
+    bool compress = false;
+    bool barriers = true;
+    string trace_path;
+    bool use_counters = false;
+    string dist_arg = "uniform";
+    bool verify = false;
+    string window_arg;
+    string select_arg;
+    string query_spec;
     
-    for (int i = arg_offset + 3; i < argc; i++) {
+    for (int i = options_start; i < argc; i++) {
         string arg = argv[i];
         if (arg == "-v" || arg == "--verbose") verbose = true;
         if (arg == "-r" || arg == "--results") show_results = true;
+        if (arg == "--ranking" && i + 1 < argc) {
+            string kernel = argv[++i];
+            ranking_set = true;
+            if (kernel == "merge") {
+                ranking_kernel = RankingKernel::MERGE;
+            } else if (kernel == "index") {
+                ranking_kernel = RankingKernel::INDEX;
+            } else if (kernel == "bsearch") {
+                ranking_kernel = RankingKernel::BSEARCH;
+            } else if (kernel == "auto") {
+                ranking_kernel = RankingKernel::AUTO;
+            } else {
+                if (rank == 0) cerr << "ERROR: kernel de ranking desconocido: " << kernel << "\n";
+                MPI_Finalize();
+                return 1;
+            }
+        }
+        if (arg == "--engine" && i + 1 < argc) engine_arg = argv[++i];
+        if (arg == "--sort" && i + 1 < argc) {
+            string backend = argv[++i];
+            if (backend == "radix") {
+                sort_backend = SortBackend::RADIX;
+            } else if (backend == "std") {
+                sort_backend = SortBackend::STD;
+            } else if (backend == "auto") {
+                sort_backend = SortBackend::AUTO;
+            } else {
+                if (rank == 0) cerr << "ERROR: sort desconocido: " << backend << "\n";
+                MPI_Finalize();
+                return 1;
+            }
+        }
+        if (arg == "--threads" && i + 1 < argc) threads = atoi(argv[++i]);
+        if (arg == "--pipeline" && i + 1 < argc) pipeline_segments = atoi(argv[++i]);
+        if (arg == "--scatter") scatter_ranking = true;
+        if (arg == "--compress") compress = true;
+        if (arg == "--no-barriers") barriers = false;
+        if (arg == "--trace" && i + 1 < argc) trace_path = argv[++i];
+        if (arg == "--counters") use_counters = true;
+        if (arg == "--verify") verify = true;
+        if (arg == "--serve" && i + 1 < argc) i++;  // ya leído
+        if (arg == "--window" && i + 1 < argc) window_arg = argv[++i];
+        if (arg == "--select" && i + 1 < argc) select_arg = argv[++i];
+        if (arg == "--query" && i + 1 < argc) query_spec = argv[++i];
+        if (arg == "--grid" && i + 1 < argc) grid_arg = argv[++i];
+        if (arg == "--key" && i + 1 < argc) key_arg = argv[++i];
+        if (arg == "--input" && i + 1 < argc) input_path = argv[++i];
+        if (arg == "--dist" && i + 1 < argc) dist_arg = argv[++i];
+        if (arg == "-s" || arg == "--sorted") sorted_output = true;
+        if (arg == "--output" && i + 1 < argc) {
+            output_path = argv[++i];
+            sorted_output = true;
+        }
     }
     
-    // Validaciones
-    if (N <= 0) {
-        if (rank == 0) cerr << "ERROR: N debe ser positivo\n";
+    if (threads < 1) {
+        if (rank == 0) cerr << "ERROR: --threads debe ser >= 1\n";
         MPI_Finalize();
         return 1;
     }
     
-    if (min_val >= max_val) {
-        if (rank == 0) cerr << "ERROR: min debe ser menor que max\n";
+    if (threads > 1 && thread_support < MPI_THREAD_FUNNELED) {
+        if (rank == 0) cerr << "ERROR: la implementación MPI no soporta MPI_THREAD_FUNNELED\n";
+        MPI_Finalize();
+        return 1;
+    }
+    
+    if (pipeline_segments < 0) {
+        if (rank == 0) cerr << "ERROR: --pipeline debe ser >= 1\n";
+        MPI_Finalize();
+        return 1;
+    }
+    
+    if (compress && pipeline_segments > 0) {
+        if (rank == 0) cerr << "ERROR: --compress no se combina con --pipeline\n";
+        MPI_Finalize();
+        return 1;
+    }
+    
+    if (engine_arg != "auto" && engine_arg != "sort" && engine_arg != "histogram") {
+        if (rank == 0) cerr << "ERROR: motor desconocido: " << engine_arg << "\n";
+        MPI_Finalize();
+        return 1;
+    }
+    
+    Distribution dist;
+    if (!parse_distribution(dist_arg, dist)) {
+        if (rank == 0) cerr << "ERROR: distribución desconocida: " << dist_arg << "\n";
+        MPI_Finalize();
+        return 1;
+    }
+    
+    if (dist != Distribution::UNIFORM && !input_path.empty()) {
+        if (rank == 0) cerr << "ERROR: --dist no se combina con --input\n";
+        MPI_Finalize();
+        return 1;
+    }
+    
+    if (!serve_spec.empty() &&
+        (!input_path.empty() || !output_path.empty() || show_results || dist != Distribution::UNIFORM)) {
+        if (rank == 0) cerr << "ERROR: --serve no se combina con --input, --output, --dist ni -r\n";
         MPI_Finalize();
         return 1;
     }
     
-    int p = static_cast<int>(sqrt(size));
-    if (p * p != size) {
+    RunMode mode;
+    if (!window_arg.empty()) {
+        if (sscanf(window_arg.c_str(), "%d:%d", &mode.window_steps, &mode.window_batch) != 2 ||
+            mode.window_steps < 1 || mode.window_batch < 1 || mode.window_batch > N) {
+            if (rank == 0) {
+                cerr << "ERROR: --window inválido: " << window_arg << " (se espera S:B con 1 <= B <= N)\n";
+            }
+            MPI_Finalize();
+            return 1;
+        }
+        if (!serve_spec.empty() || !input_path.empty() || sorted_output || show_results) {
+            if (rank == 0) cerr << "ERROR: --window no se combina con --serve, --input, -s/--output ni -r\n";
+            MPI_Finalize();
+            return 1;
+        }
+    }
+    
+    if (!select_arg.empty()) {
+        if (!parse_select(select_arg, N, mode.select)) {
+            if (rank == 0) {
+                cerr << "ERROR: --select inválido: " << select_arg << " (se espera una lista de q, pQ, top:K"
+                     << " o k en [1, N])\n";
+            }
+            MPI_Finalize();
+            return 1;
+        }
+        if (!serve_spec.empty() || mode.window_steps > 0 || sorted_output || show_results) {
+            if (rank == 0) cerr << "ERROR: --select no se combina con --serve, --window, -s/--output ni -r\n";
+            MPI_Finalize();
+            return 1;
+        }
+    }
+    
+    if (!query_spec.empty() && (!serve_spec.empty() || !window_arg.empty() || !select_arg.empty() ||
+                                sorted_output || show_results || verify)) {
         if (rank == 0) {
-            cerr << "ERROR: P debe ser cuadrado perfecto (P = p²)\n";
-            cerr << "Recibido: P = " << size << "\n";
-            cerr << "Valores válidos: 1, 4, 9, 16, 25, 36, 49, 64, ...\n";
+            cerr << "ERROR: --query no se combina con --serve, --window, --select, -s/--output, -r ni --verify\n";
         }
         MPI_Finalize();
         return 1;
     }
     
-    if (N % size != 0) {
+    // Consultas sin --ranking: auto (el índice)
+    if (!query_spec.empty() && !ranking_set) ranking_kernel = RankingKernel::AUTO;
+    
+    if (key_arg != "int" && key_arg != "char" && key_arg != "int64" && key_arg != "float" &&
+        key_arg != "double") {
+        if (rank == 0) cerr << "ERROR: tipo de clave desconocido: " << key_arg << "\n";
+        MPI_Finalize();
+        return 1;
+    }
+    
+    // Validaciones
+    if (N <= 0) {
+        if (rank == 0) cerr << "ERROR: N debe ser positivo\n";
+        MPI_Finalize();
+        return 1;
+    }
+    
+    Grid grid = make_grid(size, N);
+    if (!grid_arg.empty()) {
+        int rows = 0, cols = 0;
+        if (sscanf(grid_arg.c_str(), "%dx%d", &rows, &cols) != 2 || rows < 1 || cols < 1 ||
+            rows * cols != size) {
+            if (rank == 0) {
+                cerr << "ERROR: malla inválida: " << grid_arg << "\n";
+                cerr << "Se espera RxC con R·C = P = " << size << "\n";
+            }
+            MPI_Finalize();
+            return 1;
+        }
+        grid = {rows, cols, N};
+    }
+    
+    if (N < size) {
         if (rank == 0) {
-            cerr << "ERROR: N debe ser divisible por P\n";
+            cerr << "ERROR: N debe ser al menos P (un elemento por grupo)\n";
             cerr << "N = " << N << ", P = " << size << "\n";
         }
         MPI_Finalize();
         return 1;
     }
     
-    // TODOS los procesos generan los mismos datos (semilla fija)
-    vector<int> global_data = generate_random_array(N, min_val, max_val);
+    // N puede superar 2^31; lo que guarda cada proceso, no
+    if (grid.max_block_size() > INT_MAX) {
+        if (rank == 0) {
+            cerr << "ERROR: bloques de " << grid.max_block_size() << " elementos por proceso"
+                 << " (máximo " << INT_MAX << "); usar más procesos\n";
+        }
+        MPI_Finalize();
+        return 1;
+    }
     
     // Crear comunicador de fila
-    auto [row, col] = rank_to_position(rank, p);
+    auto [row, col] = rank_to_position(rank, grid);
     MPI_Comm row_comm;
     MPI_Comm_split(MPI_COMM_WORLD, row, col, &row_comm);
     
-    // Inicializar métricas
-    Metrics metrics = {0};
-    double t_start;
-    
-    // ===== EJECUCIÓN DEL ALGORITMO =====
-    MPI_Barrier(MPI_COMM_WORLD);
-    double total_start = MPI_Wtime();
+    // Contadores por hilo: el principal y cada worker del pool al arrancar
+    unique_ptr<PerfCounters> counters;
+    if (use_counters) {
+        counters = make_unique<PerfCounters>();
+        counters->add_current_thread();
+    }
     
-    // FASE 1: Input + Gossip
-    MPI_Barrier(MPI_COMM_WORLD);
-    t_start = MPI_Wtime();
-    vector<int> local_data = phase1_input_gossip(global_data, rank, size, p);
-    vector<int> original_data = local_data;  // Guardar copia para -r
-    MPI_Barrier(MPI_COMM_WORLD);
-    metrics.phase1_time = MPI_Wtime() - t_start;
-    
-    // FASE 2: Broadcast
-    MPI_Barrier(MPI_COMM_WORLD);
-    t_start = MPI_Wtime();
-    vector<int> broadcasted_data = phase2_broadcast(local_data, rank, p, row_comm);
-    MPI_Barrier(MPI_COMM_WORLD);
-    metrics.phase2_time = MPI_Wtime() - t_start;
-    
-    // FASE 3: Sort
-    MPI_Barrier(MPI_COMM_WORLD);
-    t_start = MPI_Wtime();
-    phase3_sort(local_data);
-    MPI_Barrier(MPI_COMM_WORLD);
-    metrics.phase3_time = MPI_Wtime() - t_start;
-    
-    // FASE 4: Ranking
-    MPI_Barrier(MPI_COMM_WORLD);
-    t_start = MPI_Wtime();
-    vector<int> local_ranking = phase4_local_ranking(local_data, broadcasted_data);
-    MPI_Barrier(MPI_COMM_WORLD);
-    metrics.phase4_time = MPI_Wtime() - t_start;
-    
-    // FASE 5: Reduce
-    MPI_Barrier(MPI_COMM_WORLD);
-    t_start = MPI_Wtime();
-    vector<int> reduced_ranking = phase5_reduce(local_ranking, rank, p, row_comm);
-    MPI_Barrier(MPI_COMM_WORLD);
-    metrics.phase5_time = MPI_Wtime() - t_start;
+    // Pool de hilos del modo híbrido (fases 3 y 4)
+    unique_ptr<ThreadPool> pool_storage;
+    if (threads > 1) {
+        PerfCounters* thread_counters = counters.get();
+        pool_storage = make_unique<ThreadPool>(threads, [thread_counters] {
+            if (thread_counters) thread_counters->add_current_thread();
+        });
+    }
+    ThreadPool* pool = pool_storage.get();
     
-    // Tiempo total
-    MPI_Barrier(MPI_COMM_WORLD);
-    metrics.total_time = MPI_Wtime() - total_start;
+    RunConfig config = {MPI_COMM_WORLD, grid, Ts, verbose, show_results, ranking_kernel, Engine::SORT,
+                        sort_backend, dist, threads, input_path, output_path, sorted_output,
+                        pipeline_segments, scatter_ranking, compress, barriers, verify, counters.get(), false};
     
-    // Calcular tiempos agregados
-    metrics.compute_time = metrics.phase3_time + metrics.phase4_time;
-    metrics.comm_time = metrics.phase2_time + metrics.phase5_time;
+    // Traza: unos pocos eventos por fase y por segmento del pipeline
+    if (!trace_path.empty()) trace().enable(256 + 4 * pipeline_segments);
     
-    // ===== SALIDA =====
-    print_metrics(rank, size, N, p, metrics, Ts, verbose);
+    // Una instancia del motor por tipo de clave
+    bool serving = !serve_spec.empty();
+    auto run = [&](auto key) {
+        using Key = decltype(key);
+        if (serving) return serve<Key>(config, engine_arg, serve_spec, rank, row_comm, pool);
+        if (!query_spec.empty()) return run_query<Key>(config, min_arg, max_arg, query_spec, rank, row_comm, pool);
+        return run_with_key<Key>(config, engine_arg, min_arg, max_arg, rank, row_comm, pool, nullptr, mode);
+    };
+    int status;
+    if (key_arg == "char") {
+        status = run(char());
+    } else if (key_arg == "int64") {
+        status = run(int64_t());
+    } else if (key_arg == "float") {
+        status = run(float());
+    } else if (key_arg == "double") {
+        status = run(double());
+    } else {
+        status = run(int());
+    }
     
-    if (show_results) {
-        for (int i = 0; i < size; i++) {
-            if (rank == i) {
-                print_process_data(rank, p, original_data, local_data,
-                                  broadcasted_data, local_ranking, reduced_ranking);
-            }
-            MPI_Barrier(MPI_COMM_WORLD);
+    // Relojes alineados con rank 0 y un único archivo escrito por rank 0
+    if (!trace_path.empty()) {
+        string label = "rank " + to_string(rank) + " (fila " + to_string(row) + ", col " +
+                       to_string(col) + ")";
+        if (!trace().write(trace_path, label, MPI_COMM_WORLD)) {
+            if (rank == 0) cerr << "ERROR: no se pudo escribir " << trace_path << "\n";
+            status = 1;
+        } else if (rank == 0 && verbose) {
+            cout << "Traza: " << trace_path << "\n";
         }
     }
     
     // Cleanup
     MPI_Comm_free(&row_comm);
     MPI_Finalize();
-    return 0;
-}
\ No newline at end of file
+    return status;
+}
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef SEARCH_INDEX_H
+#define SEARCH_INDEX_H
+
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <cstddef>
+
+// ===== ÍNDICE DE BÚSQUEDA ESTÁTICO (LAYOUT EYTZINGER) =====
+// Reordena un arreglo ordenado en el orden de un árbol binario implícito
+// (hijos de k en 2k y 2k+1). Los primeros niveles quedan juntos en pocas
+// líneas de caché y los 16 descendientes a 4 niveles de un nodo ocupan una
+// sola línea de 64 bytes (dos con claves de 64 bits), así que se pueden
+// precargar mientras se baja.
+// Responde "cuántos elementos son <= v" (equivalente a upper_bound). Key es
+// el tipo de las claves; las posiciones y los conteos son int.
+template <typename Key = int>
+class EytzingerIndex {
+public:
+    EytzingerIndex() = default;
+    ~EytzingerIndex() { release(); }
+
+    EytzingerIndex(const EytzingerIndex&) = delete;
+    EytzingerIndex& operator=(const EytzingerIndex&) = delete;
+
+    // Construye el índice a partir de un arreglo ya ordenado
+    void build(const Key* sorted, size_t n) {
+        release();
+        n_ = n;
+        levels_ = 0;
+        while ((size_t(2) << levels_) - 1 <= n_) levels_++;  // niveles completos
+
+        // t_[0] y pos_[0] no se usan; t_ alineado a 64 bytes para que el
+        // bloque de descendientes t_[16k .. 16k+15] empiece en una línea
+        size_t key_bytes = ((n_ + 1) * sizeof(Key) + 63) / 64 * 64;
+        size_t pos_bytes = ((n_ + 1) * sizeof(int) + 63) / 64 * 64;
+        t_ = static_cast<Key*>(aligned_alloc(64, key_bytes));
+        pos_ = static_cast<int*>(aligned_alloc(64, pos_bytes));
+
+        size_t next = 0;
+        fill(sorted, next, 1);
+    }
+
+    void build(const std::vector<Key>& sorted) { build(sorted.data(), sorted.size()); }
+
+    size_t size() const { return n_; }
+
+    // Cantidad de elementos <= value
+    int count_le(Key value) const {
+        size_t k = 1;
+        while (k <= n_) {
+            __builtin_prefetch(t_ + k * 16);
+            k = 2 * k + (t_[k] <= value);
+        }
+        return resolve(k);
+    }
+
+    // Versión por lotes: avanza GROUP búsquedas independientes a la vez para
+    // que los fallos de caché de cada nivel se solapen entre sí
+    void count_le_batch(const Key* queries, size_t count, int* out) const {
+        const size_t GROUP = 16;
+        size_t i = 0;
+
+        for (; i + GROUP <= count; i += GROUP) {
+            size_t k[GROUP];
+            for (size_t g = 0; g < GROUP; g++) k[g] = 1;
+
+            // Los primeros levels_ niveles están completos: sin chequeo de límites
+            for (int level = 0; level < levels_; level++) {
+                for (size_t g = 0; g < GROUP; g++) {
+                    __builtin_prefetch(t_ + k[g] * 16);
+                    k[g] = 2 * k[g] + (t_[k[g]] <= queries[i + g]);
+                }
+            }
+            // Último nivel (incompleto)
+            for (size_t g = 0; g < GROUP; g++) {
+                if (k[g] <= n_) k[g] = 2 * k[g] + (t_[k[g]] <= queries[i + g]);
+            }
+            for (size_t g = 0; g < GROUP; g++) {
+                out[i + g] = resolve(k[g]);
+            }
+        }
+
+        for (; i < count; i++) {
+            out[i] = count_le(queries[i]);
+        }
+    }
+
+    void count_le_batch(const std::vector<Key>& queries, std::vector<int>& out) const {
+        out.resize(queries.size());
+        count_le_batch(queries.data(), queries.size(), out.data());
+    }
+
+private:
+    Key* t_ = nullptr;    // claves en orden Eytzinger (1-indexado)
+    int* pos_ = nullptr;  // posición de cada nodo en el arreglo ordenado
+    size_t n_ = 0;
+    int levels_ = 0;
+
+    void fill(const Key* sorted, size_t& next, size_t k) {
+        if (k > n_) return;
+        fill(sorted, next, 2 * k);
+        t_[k] = sorted[next];
+        pos_[k] = static_cast<int>(next);
+        next++;
+        fill(sorted, next, 2 * k + 1);
+    }
+
+    // Al salir del árbol, k codifica el camino: quitar los giros a la derecha
+    // finales deja el primer nodo con clave > value (0 si no existe)
+    int resolve(size_t k) const {
+        k >>= __builtin_ffsll(~k);
+        return k == 0 ? static_cast<int>(n_) : pos_[k];
+    }
+
+    void release() {
+        free(t_);
+        free(pos_);
+        t_ = nullptr;
+        pos_ = nullptr;
+        n_ = 0;
+    }
+};
+
+#endif
@@ -2,32 +2,81 @@
 #include <vector>
 #include <algorithm>
 #include <iomanip>
-#include <random>
 #include <chrono>
+#include <cmath>
 #include <cstdlib>
+#include <cstdio>
+#include <string>
+#include <memory>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "search_index.h"
+#include "histogram_ranking.h"
+#include "radix_sort.h"
+#include "philox.h"
+#include "distributions.h"
+#include "kernel_selection.h"
+#include "perf_counters.h"
+#include "order_stat_tree.h"
 
 using namespace std;
 using namespace chrono;
 
-vector<int> generate_random_array(int N, int min_val, int max_val, int seed = 42) {
-    vector<int> data;
-    data.reserve(N);
+// Mismo generador por contador que ranking_sort_parallel (philox.h y
+// distributions.h): datos idénticos bit a bit para una misma semilla y --dist
+vector<int> generate_random_array(int N, int min_val, int max_val, int seed = 42,
+                                  Distribution dist = Distribution::UNIFORM) {
+    vector<int> data(N);
+    distribution_fill(data.data(), 0, N, (uint64_t)N, min_val, max_val, (uint64_t)seed, dist);
+    return data;
+}
+
+// Mapea los primeros N enteros (int32 binario) de path sin copiarlos.
+// MAP_POPULATE carga las páginas durante el mmap, así el tiempo de carga
+// queda medido aparte y no se mezcla con los fallos de página del ranking.
+const int* map_input_file(const string& path, int N, size_t& mapped_bytes) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cerr << "ERROR: no se pudo abrir " << path << "\n";
+        return nullptr;
+    }
     
-    mt19937 rng(seed);
-    uniform_int_distribution<int> dist(min_val, max_val);
+    struct stat st;
+    fstat(fd, &st);
+    mapped_bytes = (size_t)N * sizeof(int);
+    if ((size_t)st.st_size < mapped_bytes) {
+        cerr << "ERROR: " << path << " tiene " << st.st_size / sizeof(int)
+             << " enteros, se necesitan N = " << N << "\n";
+        close(fd);
+        return nullptr;
+    }
     
-    for (int i = 0; i < N; i++) {
-        data.push_back(dist(rng));
+    void* addr = mmap(nullptr, mapped_bytes, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        cerr << "ERROR: mmap falló para " << path << "\n";
+        return nullptr;
     }
     
-    return data;
+    return static_cast<const int*>(addr);
 }
 
-vector<int> sequential_ranking_sort(const vector<int>& data) {
-    int N = data.size();
-    
-    vector<int> sorted_data = data;
-    sort(sorted_data.begin(), sorted_data.end());
+// Sort usado por los motores de comparación: std::sort o radix (1..T hilos)
+void sort_data(vector<int>& data, const string& backend, int threads) {
+    if (backend == "radix") {
+        radix_sort(data, threads);
+    } else {
+        sort(data.begin(), data.end());
+    }
+}
+
+vector<int> sequential_ranking_sort(const int* data, int N, const string& backend = "std",
+                                    int threads = 1) {
+    vector<int> sorted_data(data, data + N);
+    sort_data(sorted_data, backend, threads);
     
     vector<int> rankings(N);
     for (int i = 0; i < N; i++) {
@@ -39,35 +88,291 @@ vector<int> sequential_ranking_sort(const vector<int>& data) {
     return rankings;
 }
 
+// Igual que sequential_ranking_sort pero las N búsquedas se resuelven sobre
+// un índice Eytzinger; index_time recibe el tiempo de construcción del índice
+vector<int> sequential_ranking_sort_index(const int* data, int N, double& index_time,
+                                          const string& backend = "std", int threads = 1) {
+    vector<int> sorted_data(data, data + N);
+    sort_data(sorted_data, backend, threads);
+    
+    auto index_start = high_resolution_clock::now();
+    EytzingerIndex index;
+    index.build(sorted_data);
+    index_time = duration<double>(high_resolution_clock::now() - index_start).count();
+    
+    vector<int> rankings(N);
+    index.count_le_batch(data, N, rankings.data());
+    
+    return rankings;
+}
+
+// Motor pairs: ordena una sola vez los pares (valor, índice) y asigna el
+// ranking en un recorrido lineal: en cada tramo de valores iguales, # <= v es
+// la posición donde termina el tramo, que se escribe en el índice original de
+// cada elemento. Evita las N búsquedas de los motores de comparación.
+// Cada par va en un entero de 64 bits: valor normalizado (ordered - mínimo)
+// arriba e índice en los index_bits de abajo, así un solo sort de enteros
+// ordena por valor y el radix no recorre los bits del índice (ver low_bits).
+// threads > 1 reparte el empaquetado, el radix y el recorrido en bloques
+// contiguos; cada hilo resuelve los tramos que empiezan en su bloque.
+vector<int> sequential_ranking_pairs(const int* data, int N, const string& backend = "std",
+                                     int threads = 1) {
+    using Traits = KeyTraits<int>;
+    threads = max(1, min(threads, N / 4096 + 1));
+    size_t chunk = ((size_t)N + threads - 1) / threads;
+    auto for_blocks = [&](auto fn) {
+        radix_detail::run_threads(threads, [&](int t) {
+            size_t begin = min((size_t)N, t * chunk);
+            fn(begin, min((size_t)N, begin + chunk));
+        });
+    };
+    
+    // Valor (32 bits) + índice (<= 31 bits): cabe en un int64 no negativo
+    Traits::Ordered base = Traits::ordered(*min_element(data, data + N));
+    int index_bits = 64 - __builtin_clzll(max(N - 1, 1));
+    vector<int64_t> pairs(N);
+    for_blocks([&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            uint64_t value = static_cast<Traits::Ordered>(Traits::ordered(data[i]) - base);
+            pairs[i] = static_cast<int64_t>((value << index_bits) | i);
+        }
+    });
+    
+    if (backend == "radix") {
+        radix_sort(pairs, threads, index_bits);
+    } else {
+        sort(pairs.begin(), pairs.end());
+    }
+    
+    vector<int> rankings(N);
+    uint64_t index_mask = (uint64_t(1) << index_bits) - 1;
+    auto value_at = [&](size_t i) { return static_cast<uint64_t>(pairs[i]) >> index_bits; };
+    for_blocks([&](size_t begin, size_t end) {
+        // El tramo que viene del bloque anterior lo termina el hilo anterior
+        while (begin > 0 && begin < end && value_at(begin) == value_at(begin - 1)) begin++;
+        for (size_t i = begin; i < end;) {
+            size_t j = i + 1;
+            while (j < (size_t)N && value_at(j) == value_at(i)) j++;
+            for (size_t k = i; k < j; k++) rankings[pairs[k] & index_mask] = j;
+            i = j;
+        }
+    });
+    
+    return rankings;
+}
+
+// Motor histograma: sin ordenar, conteo sobre [min, max] + suma prefija
+vector<int> sequential_ranking_histogram(const int* data, int N, int min_val, int max_val) {
+    vector<int> hist((size_t)((int64_t)max_val - min_val + 1), 0);
+    histogram_count(data, N, min_val, hist);
+    histogram_prefix(hist);
+    
+    vector<int> rankings(N);
+    histogram_lookup(data, N, min_val, hist, rankings.data());
+    
+    return rankings;
+}
+
+// Rankings con el motor ya resuelto (sin auto)
+vector<int> rank_with_engine(const int* data, int N, const string& engine, const string& ranking,
+                             const string& sort_backend, int threads, int min_val, int max_val,
+                             double& index_time) {
+    if (engine == "histogram") return sequential_ranking_histogram(data, N, min_val, max_val);
+    if (engine == "pairs") return sequential_ranking_pairs(data, N, sort_backend, threads);
+    if (ranking == "index") return sequential_ranking_sort_index(data, N, index_time, sort_backend, threads);
+    return sequential_ranking_sort(data, N, sort_backend, threads);
+}
+
 long long calculate_flops(int N) {
     long long sort_ops = N * log2(N);
     long long ranking_ops = N * log2(N);
     return sort_ops + ranking_ops;
 }
 
-void print_full_metrics(int N, double total_time) {
+// Motor pairs: un sort y un recorrido lineal, sin búsquedas
+long long calculate_pairs_flops(int N) {
+    return (long long)(N * log2(N)) + N;
+}
+
+// perf/counts: contadores del ranking con --counters (nullptr si no).
+// shape: forma de la muestra con --sort/--ranking auto (vacío si no)
+void print_full_metrics(int N, double total_time, double index_time,
+                        const string& engine, const string& ranking,
+                        const string& sort_backend, int threads, const string& shape,
+                        double load_time, size_t load_bytes,
+                        const PerfCounters* perf, const double* counts) {
     cout << "\n" << string(70, '=') << "\n";
     cout << "RANKING SORT SECUENCIAL - MÉTRICAS\n";
     cout << string(70, '=') << "\n";
     cout << fixed << setprecision(6);
     cout << "N:                 " << N << " elementos\n";
+    cout << "Motor:             " << engine << "\n";
+    if (engine == "sort" || engine == "pairs") {
+        cout << "Sort:              " << sort_backend;
+        if (sort_backend == "radix" || engine == "pairs") cout << " (" << threads << " hilo(s))";
+        cout << "\n";
+        if (engine == "sort") cout << "Ranking:           " << ranking << "\n";
+        if (!shape.empty()) cout << "Forma (muestra):   " << shape << " (kernels auto)\n";
+    }
+    if (load_bytes > 0) {
+        cout << "Carga (mmap):      " << (load_time * 1000) << " ms ("
+             << (load_bytes / load_time / 1e9) << " GB/s)\n";
+    }
     cout << "Tiempo:            " << (total_time * 1000) << " ms\n";
+    if (index_time > 0) {
+        cout << "  - Índice:        " << (index_time * 1000) << " ms\n";
+    }
     
-    long long flops = calculate_flops(N);
+    // El motor histograma no hace comparaciones: solo se reporta para sort
+    long long flops = (engine == "sort") ? calculate_flops(N)
+                    : (engine == "pairs") ? calculate_pairs_flops(N) : 2LL * N;
     double flops_per_sec = flops / total_time;
     double gflops = flops_per_sec / 1e9;
     
     cout << "FLOPs estimados:   " << flops << "\n";
     cout << "GFLOP/s:           " << gflops << "\n";
     cout << "Throughput:        " << (N / total_time) << " elem/s\n";
+    
+    if (perf) {
+        cout << "Contadores (ranking):\n";
+        cout << setprecision(0);
+        for (int c = 0; c < PERF_COUNTERS; c++) {
+            CounterSource source = perf->source(c);
+            // Relleno por caracteres, no por bytes (etiquetas UTF-8)
+            string label = PERF_COUNTER_INFO[c].label;
+            size_t chars = 0;
+            for (unsigned char ch : label) chars += (ch & 0xC0) != 0x80;
+            cout << "  " << label << string(14 - chars, ' ');
+            if (source == CounterSource::NONE) {
+                cout << "n/d\n";
+                continue;
+            }
+            cout << counts[c] << " [" << counter_source_name(source)
+                 << (c == PERF_CYCLES && source != CounterSource::HARDWARE ? ", ns de CPU" : "") << "]\n";
+        }
+        if (perf->source(PERF_CYCLES) == CounterSource::HARDWARE &&
+            perf->source(PERF_INSTRUCTIONS) == CounterSource::HARDWARE && counts[PERF_CYCLES] > 0) {
+            cout << setprecision(2) << "  IPC           " << counts[PERF_INSTRUCTIONS] / counts[PERF_CYCLES] << "\n";
+        }
+        cout << setprecision(6);
+    }
     cout << string(70, '=') << "\n";
 }
 
+// ===== VENTANA DESLIZANTE (--window) =====
+// Versión secuencial de --window de ranking_sort_parallel: un solo
+// OrderStatTree (order_stat_tree.h) con las N claves más recientes del flujo
+// (stream_fill; las primeras N son las de siempre). Cada paso inserta B,
+// borra las B más viejas y rankea las nuevas (# <= v). Recalcular todo se
+// mide con el motor elegido sobre la ventana final, y sus rankings de las
+// últimas B claves verifican los del árbol.
+
+int run_window(int N, int min_val, int max_val, Distribution dist, int steps, int batch,
+               const string& engine, const string& ranking, const string& sort_backend, int threads,
+               bool time_only) {
+    long long length = N + (long long)steps * batch;
+    vector<int> stream(length);
+    stream_fill(stream.data(), 0, length, (uint64_t)N, min_val, max_val, 42, dist);
+    
+    auto build_start = high_resolution_clock::now();
+    vector<int> initial(stream.begin(), stream.begin() + N);
+    sort(initial.begin(), initial.end());
+    OrderStatTree<int> tree;
+    tree.build(initial);
+    double build_time = duration<double>(high_resolution_clock::now() - build_start).count();
+    vector<int>().swap(initial);
+    
+    vector<int64_t> counts(batch);
+    vector<double> update_times, query_times;
+    double step_total = 0;
+    long long missing = 0;  // vencidas que el árbol no tenía (debe quedar en 0)
+    for (int s = 0; s < steps; s++) {
+        const int* arrivals = stream.data() + N + (long long)s * batch;
+        const int* expired = stream.data() + (long long)s * batch;
+        
+        auto start = high_resolution_clock::now();
+        for (int k = 0; k < batch; k++) tree.insert(arrivals[k]);
+        for (int k = 0; k < batch; k++) missing += !tree.erase(expired[k]);
+        auto updated = high_resolution_clock::now();
+        for (int k = 0; k < batch; k++) counts[k] = tree.count_le(arrivals[k]);
+        auto end = high_resolution_clock::now();
+        
+        update_times.push_back(duration<double>(updated - start).count());
+        query_times.push_back(duration<double>(end - updated).count());
+        step_total += duration<double>(end - start).count();
+    }
+    double step_mean = step_total / steps;
+    
+    // Recalcular todo: la ventana final completa con el motor elegido
+    const int* window = stream.data() + (long long)steps * batch;
+    double index_time = 0;
+    auto full_start = high_resolution_clock::now();
+    vector<int> full = rank_with_engine(window, N, engine, ranking, sort_backend, threads, min_val, max_val,
+                                        index_time);
+    double full_time = duration<double>(high_resolution_clock::now() - full_start).count();
+    
+    long long mismatches = missing + (tree.size() != N);
+    for (int k = 0; k < batch; k++) mismatches += counts[k] != full[N - batch + k];
+    
+    if (time_only) {
+        cout << fixed << setprecision(6) << step_mean << endl;
+        return mismatches > 0 ? 1 : 0;
+    }
+    
+    // Percentil q en ms de tiempos ordenados (rango más cercano)
+    auto percentile_ms = [](const vector<double>& sorted_values, double q) {
+        size_t k = static_cast<size_t>(ceil(q * sorted_values.size()));
+        return sorted_values[max<size_t>(k, 1) - 1] * 1000;
+    };
+    sort(update_times.begin(), update_times.end());
+    sort(query_times.begin(), query_times.end());
+    cout << fixed << setprecision(6);
+    cout << "\n" << string(70, '=') << "\n";
+    cout << "VENTANA DESLIZANTE SECUENCIAL - MÉTRICAS\n";
+    cout << string(70, '=') << "\n";
+    cout << "Ventana:           " << N << " elementos (" << distribution_name(dist) << ")\n";
+    cout << "Pasos:             " << steps << " × " << batch << " claves (llegan y vencen)\n";
+    cout << "Árbol:             altura " << tree.height() << ", carga " << build_time * 1000 << " ms\n";
+    cout << "Actualizar (ms):   p50 " << percentile_ms(update_times, 0.50) << " | p90 "
+         << percentile_ms(update_times, 0.90) << " | máx " << update_times.back() * 1000 << "\n";
+    cout << "Consultar (ms):    p50 " << percentile_ms(query_times, 0.50) << " | p90 "
+         << percentile_ms(query_times, 0.90) << " | máx " << query_times.back() * 1000 << "\n";
+    cout << "Paso (media):      " << step_mean * 1000 << " ms (" << batch / step_mean / 1e6
+         << " M rankings/s)\n";
+    cout << "Recalcular todo:   " << full_time * 1000 << " ms (motor " << engine << ")\n";
+    cout << "Speedup por paso:  " << full_time / step_mean << "x\n";
+    cout << "Verificación:      " << (mismatches == 0 ? "OK" : "FALLÓ") << " (último paso: " << batch
+         << " rankings contra recalcular todo)\n";
+    cout << string(70, '=') << "\n";
+    return mismatches > 0 ? 1 : 0;
+}
+
+// ranking_bench.cpp incluye este archivo sin su main para reusar el baseline
+#ifndef SEQUENTIAL_NO_MAIN
 int main(int argc, char** argv) {
     if (argc < 4) {
-        cerr << "Uso: " << argv[0] << " <N> <min> <max> [--time-only]\n";
+        cerr << "Uso: " << argv[0] << " <N> <min> <max> [--time-only] [--ranking K] [--engine E]\n"
+             << "       [--sort S] [--threads T] [--input F] [--dist D] [--counters] [--window S:B]\n";
         cerr << "\nOpciones:\n";
         cerr << "  --time-only    Solo imprime el tiempo (para usar con MPI)\n";
+        cerr << "  --ranking K    bsearch (defecto) | index (índice Eytzinger) | auto\n";
+        cerr << "  --engine E     auto (defecto) | sort | pairs | histogram\n";
+        cerr << "                 pairs ordena (valor, índice) una vez y asigna los\n";
+        cerr << "                 rankings en un recorrido; sort busca cada elemento\n";
+        cerr << "                 en la copia ordenada (--ranking). auto: histogram si\n";
+        cerr << "                 el rango entra, si no pairs (sort si se da --ranking)\n";
+        cerr << "  --sort S       std (defecto) | radix | auto\n";
+        cerr << "                 auto elige según una muestra de los datos (ver\n";
+        cerr << "                 kernel_selection.h); el tiempo incluye el muestreo\n";
+        cerr << "  --threads T    Hilos para el radix sort y el motor pairs (defecto 1)\n";
+        cerr << "  --input F      Rankear los primeros N int32 del archivo F (mmap)\n";
+        cerr << "  --dist D       Forma de los datos generados: uniform (defecto) | sorted |\n";
+        cerr << "                 reverse | nearly-sorted | few-unique | gaussian | zipf\n";
+        cerr << "  --counters     Contadores de rendimiento del ranking (perf_event_open)\n";
+        cerr << "  --window S:B   Ventana deslizante de N claves: S pasos en los que llegan B\n";
+        cerr << "                 claves, vencen las B más viejas y se rankean las nuevas con\n";
+        cerr << "                 un árbol de estadísticos de orden (order_stat_tree.h).\n";
+        cerr << "                 Compara el paso contra recalcular todo con el motor elegido\n";
         cerr << "\nEjemplos:\n";
         cerr << "  " << argv[0] << " 1000 1 100\n";
         cerr << "  " << argv[0] << " 1000 1 100 --time-only\n";
@@ -79,8 +384,55 @@ int main(int argc, char** argv) {
     int max_val = atoi(argv[3]);
     
     bool time_only = false;
+    string ranking = "bsearch";
+    bool ranking_set = false;
+    string engine = "auto";
+    string sort_backend = "std";
+    int threads = 1;
+    string input_path;
+    string dist_arg = "uniform";
+    bool use_counters = false;
+    string window_arg;
     for (int i = 4; i < argc; i++) {
-        if (string(argv[i]) == "--time-only") time_only = true;
+        string arg = argv[i];
+        if (arg == "--time-only") time_only = true;
+        if (arg == "--ranking" && i + 1 < argc) {
+            ranking = argv[++i];
+            ranking_set = true;
+        }
+        if (arg == "--engine" && i + 1 < argc) engine = argv[++i];
+        if (arg == "--sort" && i + 1 < argc) sort_backend = argv[++i];
+        if (arg == "--threads" && i + 1 < argc) threads = atoi(argv[++i]);
+        if (arg == "--input" && i + 1 < argc) input_path = argv[++i];
+        if (arg == "--dist" && i + 1 < argc) dist_arg = argv[++i];
+        if (arg == "--counters") use_counters = true;
+        if (arg == "--window" && i + 1 < argc) window_arg = argv[++i];
+    }
+    
+    if (ranking != "bsearch" && ranking != "index" && ranking != "auto") {
+        cerr << "ERROR: kernel de ranking desconocido: " << ranking << "\n";
+        return 1;
+    }
+    
+    if (engine != "auto" && engine != "sort" && engine != "pairs" && engine != "histogram") {
+        cerr << "ERROR: motor desconocido: " << engine << "\n";
+        return 1;
+    }
+    
+    if (sort_backend != "std" && sort_backend != "radix" && sort_backend != "auto") {
+        cerr << "ERROR: sort desconocido: " << sort_backend << "\n";
+        return 1;
+    }
+    
+    Distribution dist;
+    if (!parse_distribution(dist_arg, dist)) {
+        cerr << "ERROR: distribución desconocida: " << dist_arg << "\n";
+        return 1;
+    }
+    
+    if (threads < 1) {
+        cerr << "ERROR: --threads debe ser >= 1\n";
+        return 1;
     }
     
     if (N <= 0) {
@@ -93,19 +445,110 @@ int main(int argc, char** argv) {
         return 1;
     }
     
-    vector<int> data = generate_random_array(N, min_val, max_val);
+    if (engine == "histogram" && !histogram_range_fits(min_val, max_val)) {
+        cerr << "ERROR: el motor histogram admite hasta " << (long long)HISTOGRAM_MAX_VALUES
+             << " valores en [min, max]; usar --engine sort\n";
+        return 1;
+    }
+    
+    int window_steps = 0, window_batch = 0;
+    if (!window_arg.empty()) {
+        if (sscanf(window_arg.c_str(), "%d:%d", &window_steps, &window_batch) != 2 || window_steps < 1 ||
+            window_batch < 1 || window_batch > N) {
+            cerr << "ERROR: --window inválido: " << window_arg << " (se espera S:B con 1 <= B <= N)\n";
+            return 1;
+        }
+        if (!input_path.empty() || use_counters) {
+            cerr << "ERROR: --window no se combina con --input ni --counters\n";
+            return 1;
+        }
+    }
+    
+    if (engine == "auto") {
+        engine = histogram_engine_fits(min_val, max_val, N) ? "histogram" : ranking_set ? "sort" : "pairs";
+    }
+    
+    if (window_steps > 0) {
+        // Kernels auto como en una corrida normal, con la muestra de la ventana inicial
+        if ((engine == "sort" || engine == "pairs") && (sort_backend == "auto" || ranking == "auto")) {
+            vector<int> initial = generate_random_array(N, min_val, max_val, 42, dist);
+            if (sort_backend == "auto") {
+                sort_backend = prefer_radix(sample_shape(initial.data(), N), N) ? "radix" : "std";
+            }
+            if (ranking == "auto") ranking = "index";
+        }
+        return run_window(N, min_val, max_val, dist, window_steps, window_batch, engine, ranking, sort_backend,
+                          threads, time_only);
+    }
+    
+    // Entrada: generada (philox) o mapeada desde archivo sin copia
+    vector<int> generated;
+    const int* data = nullptr;
+    double load_time = 0;
+    size_t load_bytes = 0;
     
+    if (input_path.empty()) {
+        generated = generate_random_array(N, min_val, max_val, 42, dist);
+        data = generated.data();
+    } else {
+        auto load_start = high_resolution_clock::now();
+        data = map_input_file(input_path, N, load_bytes);
+        load_time = duration<double>(high_resolution_clock::now() - load_start).count();
+        if (!data) return 1;
+        
+        // El histograma indexa por v - min: los valores deben estar en rango
+        if (engine == "histogram") {
+            for (int i = 0; i < N; i++) {
+                if (data[i] < min_val || data[i] > max_val) {
+                    cerr << "ERROR: " << input_path << " tiene valores fuera de [min, max]\n";
+                    return 1;
+                }
+            }
+        }
+    }
+    
+    // Los hilos del radix se crean después: los cuenta inherit (perf_counters.h)
+    unique_ptr<PerfCounters> perf;
+    double counts_start[PERF_COUNTERS], counts[PERF_COUNTERS];
+    if (use_counters) {
+        perf = make_unique<PerfCounters>();
+        perf->add_current_thread();
+        perf->read(counts_start);
+    }
+    
+    double index_time = 0;
     auto start = high_resolution_clock::now();
-    vector<int> rankings = sequential_ranking_sort(data);
+    
+    // Kernels auto: sin kernel merge, el ranking es index (le gana a bsearch
+    // en todas las formas medidas); la forma decide el sort
+    string shape;
+    if ((engine == "sort" || engine == "pairs") && (sort_backend == "auto" || ranking == "auto")) {
+        DataShape sampled = sample_shape(data, N);
+        shape = data_shape_name(sampled);
+        if (sort_backend == "auto") sort_backend = prefer_radix(sampled, N) ? "radix" : "std";
+        if (ranking == "auto") ranking = "index";
+    }
+    
+    vector<int> rankings = rank_with_engine(data, N, engine, ranking, sort_backend, threads, min_val, max_val,
+                                            index_time);
     auto end = high_resolution_clock::now();
+    if (perf) {
+        perf->read(counts);
+        for (int c = 0; c < PERF_COUNTERS; c++) counts[c] -= counts_start[c];
+    }
     
     double total_time = duration<double>(end - start).count();
     
     if (time_only) {
         cout << fixed << setprecision(6) << total_time << endl;
     } else {
-        print_full_metrics(N, total_time);
+        print_full_metrics(N, total_time, index_time, engine, ranking, sort_backend, threads, shape,
+                           load_time, load_bytes, perf.get(), counts);
     }
     
+    if (load_bytes > 0) munmap(const_cast<int*>(data), load_bytes);
+    
     return 0;
-}
\ No newline at end of file
+}
+
+#endif
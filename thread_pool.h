@@ -0,0 +1,284 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+
+// ===== POOL DE HILOS CON WORK STEALING =====
+// Cada participante tiene su propia cola: toma trabajo del final (LIFO, datos
+// aún en caché) y cuando se queda sin tareas roba del frente de otra cola.
+// El hilo que llama a wait() (el hilo MPI en modo FUNNELED) también ejecuta
+// tareas mientras espera, así que un pool de T hilos crea T-1 workers.
+// El tiempo ocupado de cada participante se acumula para medir utilización.
+class ThreadPool {
+public:
+    // Contador de tareas pendientes de un grupo (un parallel_for, un sort...)
+    struct TaskGroup {
+        std::atomic<size_t> pending{0};
+    };
+
+    // on_start (opcional) corre una vez en cada worker antes de aceptar
+    // tareas, p. ej. para abrir contadores por hilo; el constructor espera a
+    // que todos lo hayan terminado
+    explicit ThreadPool(int threads, std::function<void()> on_start = nullptr)
+        : slots_(std::max(1, threads)) {
+        for (auto& slot : slots_) slot = std::make_unique<Slot>();
+        std::atomic<int> started{0};
+        for (int i = 1; i < size(); i++) {
+            workers_.emplace_back([this, i, &on_start, &started] {
+                if (on_start) on_start();
+                started.fetch_add(1, std::memory_order_release);
+                worker_loop(i);
+            });
+        }
+        while (started.load(std::memory_order_acquire) < size() - 1) std::this_thread::yield();
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            stop_ = true;
+        }
+        sleep_cv_.notify_all();
+        for (auto& w : workers_) w.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    int size() const { return static_cast<int>(slots_.size()); }
+
+    // Encola fn en el grupo. Desde un worker va a su propia cola; desde fuera
+    // se reparte round-robin para que el robo arranque balanceado.
+    void submit(TaskGroup& group, std::function<void()> fn) {
+        group.pending.fetch_add(1, std::memory_order_relaxed);
+        int target = (current_pool_ == this) ? current_slot_
+                                             : static_cast<int>(next_slot_++ % slots_.size());
+        {
+            std::lock_guard<std::mutex> lock(slots_[target]->mutex);
+            slots_[target]->tasks.push_back({std::move(fn), &group});
+        }
+        {
+            // Bajo sleep_mutex_, como stop_: un worker que ya evaluó el
+            // predicado y va a dormir no puede perderse este aviso
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            queued_.fetch_add(1, std::memory_order_release);
+        }
+        sleep_cv_.notify_one();
+    }
+
+    // Espera al grupo ejecutando tareas (propias o robadas) mientras tanto
+    void wait(TaskGroup& group) {
+        int self = (current_pool_ == this) ? current_slot_ : 0;
+        while (group.pending.load(std::memory_order_acquire) > 0) {
+            if (!run_one(self)) std::this_thread::yield();
+        }
+    }
+
+    // fn(lo, hi) sobre [begin, end) en bloques de al menos grain elementos
+    template <typename Fn>
+    void parallel_for(size_t begin, size_t end, size_t grain, Fn fn) {
+        if (begin >= end) return;
+        grain = std::max<size_t>(grain, 1);
+        if (size() == 1 || end - begin <= grain) {
+            fn(begin, end);
+            return;
+        }
+        TaskGroup group;
+        for (size_t lo = begin; lo < end; lo += grain) {
+            size_t hi = std::min(end, lo + grain);
+            submit(group, [fn, lo, hi] { fn(lo, hi); });
+        }
+        wait(group);
+    }
+
+    // Tiempo ocupado acumulado por todos los participantes (segundos)
+    double busy_time() const {
+        double total = 0;
+        for (auto& slot : slots_) total += slot->busy.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    void reset_stats() {
+        for (auto& slot : slots_) slot->busy.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    struct Task {
+        std::function<void()> fn;
+        TaskGroup* group;
+    };
+
+    struct Slot {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::atomic<double> busy{0};
+    };
+
+    std::vector<std::unique_ptr<Slot>> slots_;  // slot 0: hilo que creó el pool
+    std::vector<std::thread> workers_;
+    std::atomic<size_t> queued_{0};
+    std::atomic<size_t> next_slot_{0};
+    std::mutex sleep_mutex_;
+    std::condition_variable sleep_cv_;
+    bool stop_ = false;
+
+    static thread_local ThreadPool* current_pool_;
+    static thread_local int current_slot_;
+
+    bool pop_local(int self, Task& task) {
+        Slot& slot = *slots_[self];
+        std::lock_guard<std::mutex> lock(slot.mutex);
+        if (slot.tasks.empty()) return false;
+        task = std::move(slot.tasks.back());
+        slot.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(int self, Task& task) {
+        int n = size();
+        for (int k = 1; k < n; k++) {
+            Slot& victim = *slots_[(self + k) % n];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.tasks.empty()) continue;
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    bool run_one(int self) {
+        if (queued_.load(std::memory_order_acquire) == 0) return false;
+        Task task;
+        if (!pop_local(self, task) && !steal(self, task)) return false;
+        queued_.fetch_sub(1, std::memory_order_relaxed);
+
+        ThreadPool* saved_pool = current_pool_;
+        int saved_slot = current_slot_;
+        current_pool_ = this;
+        current_slot_ = self;
+
+        auto start = std::chrono::steady_clock::now();
+        task.fn();
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        current_pool_ = saved_pool;
+        current_slot_ = saved_slot;
+
+        // Solo este participante escribe su contador
+        Slot& slot = *slots_[self];
+        slot.busy.store(slot.busy.load(std::memory_order_relaxed) + elapsed, std::memory_order_relaxed);
+        task.group->pending.fetch_sub(1, std::memory_order_release);
+        return true;
+    }
+
+    void worker_loop(int self) {
+        current_pool_ = this;
+        current_slot_ = self;
+        while (true) {
+            if (run_one(self)) continue;
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            sleep_cv_.wait(lock, [this] {
+                return stop_ || queued_.load(std::memory_order_acquire) > 0;
+            });
+            if (stop_) return;
+        }
+    }
+};
+
+inline thread_local ThreadPool* ThreadPool::current_pool_ = nullptr;
+inline thread_local int ThreadPool::current_slot_ = 0;
+
+// ===== SORT PARALELO SOBRE EL POOL =====
+// Ordena bloques independientes (una tarea cada uno) y luego los mezcla por
+// niveles de a pares. Cada merge se corta con merge path (co-ranking) en
+// tramos independientes para que los niveles altos también usen todo el pool.
+
+namespace pool_detail {
+
+// Cantidad de elementos de a que van antes de la posición d de la mezcla a+b
+template <typename T>
+size_t merge_path_split(const T* a, size_t na, const T* b, size_t nb, size_t d) {
+    size_t lo = d > nb ? d - nb : 0;
+    size_t hi = std::min(d, na);
+    while (lo < hi) {
+        size_t i = lo + (hi - lo) / 2;
+        if (a[i] <= b[d - i - 1]) {
+            lo = i + 1;
+        } else {
+            hi = i;
+        }
+    }
+    return lo;
+}
+
+}  // namespace pool_detail
+
+// Mezcla a y b en out cortando la salida en tramos de ~grain elementos
+template <typename T>
+void parallel_merge(ThreadPool& pool, ThreadPool::TaskGroup& group,
+                    const T* a, size_t na, const T* b, size_t nb, T* out, size_t grain) {
+    size_t total = na + nb;
+    for (size_t d = 0; d < total; d += grain) {
+        size_t d_end = std::min(total, d + grain);
+        pool.submit(group, [=] {
+            size_t i0 = pool_detail::merge_path_split(a, na, b, nb, d);
+            size_t i1 = pool_detail::merge_path_split(a, na, b, nb, d_end);
+            std::merge(a + i0, a + i1, b + (d - i0), b + (d_end - i1), out + d);
+        });
+    }
+}
+
+// sort_chunk(first, last) ordena un bloque (std::sort, radix serial, ...)
+template <typename T, typename SortChunk>
+void parallel_sort(ThreadPool& pool, std::vector<T>& data, SortChunk sort_chunk) {
+    size_t n = data.size();
+    size_t chunks = 1;
+    while (chunks < size_t(pool.size()) * 2 && n / (chunks * 2) >= 4096) chunks *= 2;
+    if (chunks == 1) {
+        sort_chunk(data.begin(), data.end());
+        return;
+    }
+
+    auto bound = [&](size_t c) { return n * c / chunks; };
+
+    ThreadPool::TaskGroup sort_group;
+    for (size_t c = 0; c < chunks; c++) {
+        size_t lo = bound(c), hi = bound(c + 1);
+        pool.submit(sort_group, [&data, &sort_chunk, lo, hi] {
+            sort_chunk(data.begin() + lo, data.begin() + hi);
+        });
+    }
+    pool.wait(sort_group);
+
+    std::vector<T> buffer(n);
+    T* src = data.data();
+    T* dst = buffer.data();
+    size_t grain = std::max<size_t>(n / (pool.size() * 4), 4096);
+
+    for (size_t width = 1; width < chunks; width *= 2) {
+        ThreadPool::TaskGroup merge_group;
+        for (size_t c = 0; c < chunks; c += 2 * width) {
+            size_t lo = bound(c);
+            size_t mid = bound(std::min(chunks, c + width));
+            size_t hi = bound(std::min(chunks, c + 2 * width));
+            parallel_merge(pool, merge_group, src + lo, mid - lo, src + mid, hi - mid, dst + lo, grain);
+        }
+        pool.wait(merge_group);
+        std::swap(src, dst);
+    }
+
+    if (src != data.data()) std::copy(src, src + n, data.data());
+}
+
+#endif
@@ -0,0 +1,171 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <mpi.h>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <limits>
+#include <algorithm>
+
+// ===== TRAZA POR PROCESO (CHROME TRACE / PERFETTO) =====
+// Cada proceso guarda intervalos (nombre, categoría, inicio, fin) en un vector
+// reservado de antemano: registrar cuesta un MPI_Wtime y un push_back, así que
+// se puede dejar activo en corridas reales. En --serve y --query el vector
+// crece con cada lote, sin tope, hasta el final del servicio (la traza cubre
+// todos los lotes): no dejarlo activo en servicios largos. Los nombres son
+// literales (no se copian). Solo registra el hilo que llama a MPI (los workers del pool no).
+// Al final se estima el desfase del reloj de cada proceso respecto de rank 0 y
+// rank 0 escribe un único JSON en formato Chrome trace (un pid por proceso),
+// que se abre en Perfetto o chrome://tracing.
+
+struct TraceEvent {
+    const char* name;
+    const char* category;
+    double begin, end;  // MPI_Wtime local
+    int arg;            // segmento del pipeline, o -1
+};
+
+class Trace {
+public:
+    void enable(size_t capacity = 4096) {
+        enabled_ = true;
+        events_.reserve(capacity);
+    }
+
+    bool enabled() const { return enabled_; }
+
+    void add(const char* name, const char* category, double begin, double end, int arg = -1) {
+        if (enabled_) events_.push_back({name, category, begin, end, arg});
+    }
+
+    // Desfase respecto de rank 0 (algoritmo de Cristian): de ROUNDS idas y
+    // vueltas se usa la más corta, cuyo punto medio es el mejor estimador del
+    // instante en que rank 0 leyó su reloj
+    void align_clock(MPI_Comm comm) {
+        const int ROUNDS = 8, TAG = 7001;
+        int rank, size;
+        MPI_Comm_rank(comm, &rank);
+        MPI_Comm_size(comm, &size);
+        offset_ = 0;
+
+        for (int r = 1; r < size; r++) {
+            if (rank == 0) {
+                for (int k = 0; k < ROUNDS; k++) {
+                    MPI_Recv(nullptr, 0, MPI_BYTE, r, TAG, comm, MPI_STATUS_IGNORE);
+                    double now = MPI_Wtime();
+                    MPI_Send(&now, 1, MPI_DOUBLE, r, TAG, comm);
+                }
+            } else if (rank == r) {
+                double best_rtt = std::numeric_limits<double>::infinity();
+                for (int k = 0; k < ROUNDS; k++) {
+                    double sent = MPI_Wtime();
+                    double remote;
+                    MPI_Send(nullptr, 0, MPI_BYTE, 0, TAG, comm);
+                    MPI_Recv(&remote, 1, MPI_DOUBLE, 0, TAG, comm, MPI_STATUS_IGNORE);
+                    double received = MPI_Wtime();
+                    if (received - sent < best_rtt) {
+                        best_rtt = received - sent;
+                        offset_ = remote - (sent + received) / 2;
+                    }
+                }
+            }
+        }
+    }
+
+    // Colectiva: alinea relojes, junta los eventos en rank 0 y este escribe
+    // path. process_label nombra al proceso en el visor. Los tiempos quedan en
+    // microsegundos desde el primer evento de la corrida.
+    bool write(const std::string& path, const std::string& process_label, MPI_Comm comm) {
+        int rank, size;
+        MPI_Comm_rank(comm, &rank);
+        MPI_Comm_size(comm, &size);
+
+        align_clock(comm);
+        double first = std::numeric_limits<double>::infinity();
+        for (const TraceEvent& e : events_) first = std::min(first, e.begin + offset_);
+        double origin;
+        MPI_Allreduce(&first, &origin, 1, MPI_DOUBLE, MPI_MIN, comm);
+
+        // Eventos de este proceso ya serializados, cada uno terminado en ",\n"
+        std::string json;
+        char line[512];
+        snprintf(line, sizeof(line),
+                 "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"%s\"}},\n"
+                 "{\"name\":\"process_sort_index\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"sort_index\":%d}},\n",
+                 rank, process_label.c_str(), rank, rank);
+        json += line;
+        for (const TraceEvent& e : events_) {
+            double ts = (e.begin + offset_ - origin) * 1e6;
+            double dur = (e.end - e.begin) * 1e6;
+            int n = snprintf(line, sizeof(line),
+                             "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":0,"
+                             "\"ts\":%.3f,\"dur\":%.3f",
+                             e.name, e.category, rank, ts, dur);
+            if (e.arg >= 0) n += snprintf(line + n, sizeof(line) - n, ",\"args\":{\"segmento\":%d}", e.arg);
+            snprintf(line + n, sizeof(line) - n, "},\n");
+            json += line;
+        }
+
+        int length = json.size();
+        std::vector<int> lengths(rank == 0 ? size : 0), displs(rank == 0 ? size : 0);
+        MPI_Gather(&length, 1, MPI_INT, lengths.data(), 1, MPI_INT, 0, comm);
+        std::string all;
+        if (rank == 0) {
+            int total = 0;
+            for (int r = 0; r < size; r++) {
+                displs[r] = total;
+                total += lengths[r];
+            }
+            all.resize(total);
+        }
+        MPI_Gatherv(json.data(), length, MPI_CHAR, &all[0], lengths.data(), displs.data(), MPI_CHAR, 0, comm);
+
+        int ok = 1;
+        if (rank == 0) {
+            if (all.size() >= 2) all.resize(all.size() - 2);  // sin la última ",\n"
+            FILE* out = fopen(path.c_str(), "w");
+            ok = out != nullptr;
+            if (out) {
+                fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n%s\n]}\n", all.c_str());
+                ok = fclose(out) == 0;
+            }
+        }
+        MPI_Bcast(&ok, 1, MPI_INT, 0, comm);
+        return ok;
+    }
+
+private:
+    bool enabled_ = false;
+    std::vector<TraceEvent> events_;
+    double offset_ = 0;  // reloj de rank 0 = MPI_Wtime local + offset_
+};
+
+// Traza del proceso (una por proceso; inactiva salvo enable())
+inline Trace& trace() {
+    static Trace instance;
+    return instance;
+}
+
+// Registra el intervalo entre su construcción y el fin del bloque
+class TraceScope {
+public:
+    TraceScope(const char* name, const char* category, int arg = -1)
+        : name_(name), category_(category), arg_(arg),
+          begin_(trace().enabled() ? MPI_Wtime() : 0) {}
+
+    ~TraceScope() {
+        if (trace().enabled()) trace().add(name_, category_, begin_, MPI_Wtime(), arg_);
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* name_;
+    const char* category_;
+    int arg_;
+    double begin_;
+};
+
+#endif
@@ -4,8 +4,11 @@
 #include <algorithm>
 #include <cmath>
 #include <iomanip>
-#include <random>
 #include <cstdlib>
+#include <cstdint>
+#include <string>
+
+#include "philox.h"
 
 using namespace std;
 
@@ -24,17 +27,11 @@ int get_diagonal_of_row(int row, int p) {
 }
 
 // FUNCIÓN PARA GENERAR NÚMEROS ALEATORIOS
+// Mismo generador por contador que ranking_sort_parallel (philox.h):
+// datos idénticos bit a bit para una misma semilla
 vector<int> generate_random_array(int N, int min_val, int max_val, int seed = 42) {
-    vector<int> data;
-    data.reserve(N);
-    
-    mt19937 rng(seed);
-    uniform_int_distribution<int> dist(min_val, max_val);
-    
-    for (int i = 0; i < N; i++) {
-        data.push_back(dist(rng));
-    }
-    
+    vector<int> data(N);
+    philox_fill(data.data(), 0, N, min_val, max_val, seed);
     return data;
 }
 
@@ -109,6 +106,36 @@ vector<int> phase4_local_ranking(
     return ranking;
 }
 
+// FASE 4 (variante merge): ordena el broadcasted junto con sus indices
+// originales y recorre sorted_local una sola vez en lugar de buscar cada valor
+vector<int> phase4_local_ranking_merge(
+    const vector<int>& sorted_local, 
+    const vector<int>& broadcasted
+) {
+    int n = broadcasted.size();
+    
+    // (valor, indice) empaquetado en 64 bits; el XOR del bit de signo mantiene el orden
+    vector<uint64_t> keyed(n);
+    for (int i = 0; i < n; i++) {
+        uint32_t key = static_cast<uint32_t>(broadcasted[i]) ^ 0x80000000u;
+        keyed[i] = (static_cast<uint64_t>(key) << 32) | static_cast<uint32_t>(i);
+    }
+    sort(keyed.begin(), keyed.end());
+    
+    vector<int> ranking(n);
+    size_t j = 0;
+    
+    for (uint64_t entry : keyed) {
+        int value = static_cast<int>(static_cast<uint32_t>(entry >> 32) ^ 0x80000000u);
+        int idx = static_cast<int>(entry & 0xFFFFFFFFu);
+        // avanzar mientras sorted_local[j] <= value
+        while (j < sorted_local.size() && sorted_local[j] <= value) j++;
+        ranking[idx] = j;
+    }
+    
+    return ranking;
+}
+
 // FASE 5: REDUCE HORIZONTAL
 vector<int> phase5_reduce(
     const vector<int>& local_ranking,
@@ -189,12 +216,13 @@ int main(int argc, char** argv) {
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
     MPI_Comm_size(MPI_COMM_WORLD, &size);
     
-    if (argc != 4) {
+    if (argc < 4 || argc > 5 || (argc == 5 && string(argv[4]) != "--merge")) {
         if (rank == 0) {
-            cerr << "Uso: " << argv[0] << " <N> <min> <max>\n";
+            cerr << "Uso: " << argv[0] << " <N> <min> <max> [--merge]\n";
             cerr << "  N:   Número de elementos a ordenar\n";
             cerr << "  min: Valor mínimo para números aleatorios\n";
             cerr << "  max: Valor máximo para números aleatorios\n";
+            cerr << "  --merge: ranking local por merge en lugar de busqueda binaria\n";
             cerr << "\nEjemplo: " << argv[0] << " 18 1 100\n";
         }
         MPI_Finalize();
@@ -204,6 +232,7 @@ int main(int argc, char** argv) {
     int N = atoi(argv[1]);
     int min_val = atoi(argv[2]);
     int max_val = atoi(argv[3]);
+    bool use_merge = (argc == 5);
     
     if (N <= 0) {
         if (rank == 0) {
@@ -274,7 +303,9 @@ int main(int argc, char** argv) {
     phase3_sort(local_data);
     
     // FASE 4: LOCAL RANKING
-    vector<int> local_ranking = phase4_local_ranking(local_data, broadcasted_data);
+    vector<int> local_ranking = use_merge
+        ? phase4_local_ranking_merge(local_data, broadcasted_data)
+        : phase4_local_ranking(local_data, broadcasted_data);
     
     // FASE 5: REDUCE HORIZONTAL
     vector<int> reduced_ranking = phase5_reduce(local_ranking, rank, size, p, row_comm);